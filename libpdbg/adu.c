@@ -21,6 +21,7 @@
 #include "operations.h"
 #include "bitutils.h"
 #include "debug.h"
+#include "stats.h"
 
 /* P8 ADU SCOM Register Definitions */
 #define P8_ALTD_CONTROL_REG	0x0
@@ -116,9 +117,9 @@ static int __adu_getmem_blocksize(struct pdbg_target *adu_target, uint64_t start
 	struct adu *adu;
 	uint8_t *output0;
 	int rc = 0;
-	uint64_t addr0, addr;
+	uint64_t addr0, addr, start;
 
-	assert(!strcmp(adu_target->class, "adu"));
+	assert(adu_target->class_id == CLASS_ADU);
 	adu = target_to_adu(adu_target);
 
 	output0 = output;
@@ -130,7 +131,14 @@ static int __adu_getmem_blocksize(struct pdbg_target *adu_target, uint64_t start
 	for (addr = addr0; addr < start_addr + size; addr += block_size) {
 		uint64_t data;
 
-		if (adu->getmem(adu, addr, &data, ci, block_size))
+		/* Each block is a separate sequence of SCOMs which mustn't be
+		 * interleaved with another thread using the same ADU */
+		start = stats_start();
+		target_lock(adu_target);
+		rc = adu->getmem(adu, addr, &data, ci, block_size);
+		target_unlock(adu_target);
+		stats_record(adu_target, PDBG_STAT_ADU_GETMEM, start, rc);
+		if (rc)
 			return -1;
 
 		/* ADU returns data in big-endian form in the register. */
@@ -194,10 +202,10 @@ static int __adu_putmem_blocksize(struct pdbg_target *adu_target, uint64_t start
 				  uint8_t *input, uint64_t size, uint8_t block_size, bool ci)
 {
 	struct adu *adu;
-	int rc = 0, tsize;
-	uint64_t addr, data, end_addr;
+	int rc = 0, tsize, block_rc;
+	uint64_t addr, data, end_addr, start;
 
-	assert(!strcmp(adu_target->class, "adu"));
+	assert(adu_target->class_id == CLASS_ADU);
 	adu = target_to_adu(adu_target);
 	end_addr = start_addr + size;
 	for (addr = start_addr; addr < end_addr; addr += tsize, input += tsize) {
@@ -219,7 +227,11 @@ static int __adu_putmem_blocksize(struct pdbg_target *adu_target, uint64_t start
 			data >>= (addr & 7ull)*8;
 		}
 
-		adu->putmem(adu, addr, data, tsize, ci, block_size);
+		start = stats_start();
+		target_lock(adu_target);
+		block_rc = adu->putmem(adu, addr, data, tsize, ci, block_size);
+		target_unlock(adu_target);
+		stats_record(adu_target, PDBG_STAT_ADU_PUTMEM, start, block_rc);
 		pdbg_progress_tick(addr - start_addr, size);
 	}
 
@@ -295,6 +307,20 @@ static int adu_reset(struct adu *adu)
 	return 0;
 }
 
+/* Polls the status register until the current command completes */
+static int adu_wait(struct adu *adu, uint64_t status_reg, uint64_t *val)
+{
+	uint64_t start = stats_start();
+	int rc;
+
+	do {
+		rc = pib_read(&adu->target, status_reg, val);
+	} while (!rc && !*val);
+
+	stats_record(&adu->target, PDBG_STAT_POLL, start, rc);
+	return rc;
+}
+
 static int p8_adu_getmem(struct adu *adu, uint64_t addr, uint64_t *data,
 			 int ci, uint8_t block_size)
 {
@@ -331,9 +357,7 @@ retry:
 	CHECK_ERR_GOTO(out, rc = pib_write(&adu->target, P8_ALTD_CMD_REG, cmd_reg));
 
 	/* Wait for completion */
-	do {
-		CHECK_ERR_GOTO(out, rc = pib_read(&adu->target, P8_ALTD_STATUS_REG, &val));
-	} while (!val);
+	CHECK_ERR_GOTO(out, rc = adu_wait(adu, P8_ALTD_STATUS_REG, &val));
 
 	if( !(val & FBC_ALTD_ADDR_DONE) ||
 	    !(val & FBC_ALTD_DATA_DONE)) {
@@ -396,9 +420,7 @@ retry:
 	CHECK_ERR_GOTO(out, rc = pib_write(&adu->target, P8_ALTD_CMD_REG, cmd_reg));
 
 	/* Wait for completion */
-	do {
-		CHECK_ERR_GOTO(out, rc = pib_read(&adu->target, P8_ALTD_STATUS_REG, &val));
-	} while (!val);
+	CHECK_ERR_GOTO(out, rc = adu_wait(adu, P8_ALTD_STATUS_REG, &val));
 
 	if( !(val & FBC_ALTD_ADDR_DONE) ||
 	    !(val & FBC_ALTD_DATA_DONE)) {
@@ -453,9 +475,7 @@ retry:
 	CHECK_ERR(pib_write(&adu->target, P9_ALTD_CMD_REG, cmd_reg));
 
 	/* Wait for completion */
-	do {
-		CHECK_ERR(pib_read(&adu->target, P9_ALTD_STATUS_REG, &val));
-	} while (!val);
+	CHECK_ERR(adu_wait(adu, P9_ALTD_STATUS_REG, &val));
 
 	if( !(val & FBC_ALTD_ADDR_DONE) ||
 	    !(val & FBC_ALTD_DATA_DONE)) {
@@ -513,9 +533,7 @@ retry:
 	CHECK_ERR(pib_write(&adu->target, P9_ALTD_CMD_REG, cmd_reg));
 
 	/* Wait for completion */
-	do {
-		CHECK_ERR(pib_read(&adu->target, P9_ALTD_STATUS_REG, &val));
-	} while (!val);
+	CHECK_ERR(adu_wait(adu, P9_ALTD_STATUS_REG, &val));
 
 	if( !(val & FBC_ALTD_ADDR_DONE) ||
 	    !(val & FBC_ALTD_DATA_DONE)) {
@@ -0,0 +1,291 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Asynchronous FSI, PIB and ADU accesses. Each queue starts a thread (an
+ * engine) for every bus it is given operations for the first time they are
+ * submitted. An engine runs the operations for its bus one at a time using
+ * the normal synchronous accessors and moves them to the queue's completion
+ * list. The eventfd counts the completed operations which haven't been
+ * reaped yet so that it can be polled along with other file descriptors.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "target.h"
+#include "debug.h"
+
+struct async_engine {
+	struct pdbg_async *queue;
+	struct pdbg_target *bus;
+	pthread_t tid;
+	pthread_cond_t cond;
+	struct pdbg_async_op *head, *tail;
+};
+
+struct pdbg_async {
+	/* Protects everything below including the engine lists */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct async_engine **engines;
+	int engine_count;
+	struct pdbg_async_op *done_head, *done_tail;
+	int outstanding;
+	bool stop;
+	int fd;
+};
+
+static void async_op_append(struct pdbg_async_op **head, struct pdbg_async_op **tail,
+			    struct pdbg_async_op *op)
+{
+	op->next = NULL;
+	if (*tail)
+		(*tail)->next = op;
+	else
+		*head = op;
+	*tail = op;
+}
+
+static struct pdbg_async_op *async_op_pop(struct pdbg_async_op **head,
+					  struct pdbg_async_op **tail)
+{
+	struct pdbg_async_op *op = *head;
+
+	if (op) {
+		*head = op->next;
+		if (!*head)
+			*tail = NULL;
+		op->next = NULL;
+	}
+
+	return op;
+}
+
+/* Operations through the same FSI link, or the same PIB if there isn't one,
+ * end up waiting for each other so they share an engine */
+static struct pdbg_target *async_bus(struct pdbg_target *target)
+{
+	struct pdbg_target *bus = NULL, *parent;
+
+	for (parent = target; parent; parent = parent->parent)
+		if (parent->class_id == CLASS_FSI)
+			bus = parent;
+
+	for (parent = target; !bus && parent; parent = parent->parent)
+		if (parent->class_id == CLASS_PIB)
+			bus = parent;
+
+	return bus ? bus : target;
+}
+
+static int async_op_run(struct pdbg_async_op *op)
+{
+	uint32_t value;
+	int rc;
+
+	switch (op->type) {
+	case PDBG_ASYNC_FSI_READ:
+		rc = fsi_read(op->target, op->addr, &value);
+		if (!rc)
+			op->data = value;
+		return rc;
+
+	case PDBG_ASYNC_FSI_WRITE:
+		return fsi_write(op->target, op->addr, op->data);
+
+	case PDBG_ASYNC_PIB_READ:
+		return pib_read(op->target, op->addr, &op->data);
+
+	case PDBG_ASYNC_PIB_WRITE:
+		return pib_write(op->target, op->addr, op->data);
+
+	case PDBG_ASYNC_ADU_GETMEM:
+		return __adu_getmem(op->target, op->addr, op->buf, op->size, op->ci);
+
+	case PDBG_ASYNC_ADU_PUTMEM:
+		return __adu_putmem(op->target, op->addr, op->buf, op->size, op->ci);
+	}
+
+	return -1;
+}
+
+static void *async_engine_run(void *arg)
+{
+	struct async_engine *engine = arg;
+	struct pdbg_async *queue = engine->queue;
+	struct pdbg_async_op *op;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		while (!engine->head && !queue->stop)
+			pthread_cond_wait(&engine->cond, &queue->lock);
+
+		op = async_op_pop(&engine->head, &engine->tail);
+		if (!op)
+			break;
+
+		pthread_mutex_unlock(&queue->lock);
+		op->rc = async_op_run(op);
+		pthread_mutex_lock(&queue->lock);
+
+		async_op_append(&queue->done_head, &queue->done_tail, op);
+		if (write(queue->fd, &one, sizeof(one)) != sizeof(one))
+			PR_ERROR("Unable to signal completion\n");
+		pthread_cond_broadcast(&queue->cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+/* Called with the queue lock held */
+static struct async_engine *async_engine_get(struct pdbg_async *queue,
+					     struct pdbg_target *bus)
+{
+	struct async_engine *engine, **engines;
+	int i;
+
+	for (i = 0; i < queue->engine_count; i++)
+		if (queue->engines[i]->bus == bus)
+			return queue->engines[i];
+
+	engines = realloc(queue->engines, (queue->engine_count + 1) * sizeof(*engines));
+	if (!engines)
+		return NULL;
+	queue->engines = engines;
+
+	engine = calloc(1, sizeof(*engine));
+	if (!engine)
+		return NULL;
+
+	engine->queue = queue;
+	engine->bus = bus;
+	pthread_cond_init(&engine->cond, NULL);
+	if (pthread_create(&engine->tid, NULL, async_engine_run, engine)) {
+		PR_ERROR("Unable to start a thread for %s\n", bus->dn_name);
+		pthread_cond_destroy(&engine->cond);
+		free(engine);
+		return NULL;
+	}
+
+	queue->engines[queue->engine_count++] = engine;
+	return engine;
+}
+
+struct pdbg_async *pdbg_async_create(void)
+{
+	struct pdbg_async *queue;
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue)
+		return NULL;
+
+	queue->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+	if (queue->fd < 0) {
+		free(queue);
+		return NULL;
+	}
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+
+	return queue;
+}
+
+void pdbg_async_destroy(struct pdbg_async *queue)
+{
+	int i;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = true;
+	for (i = 0; i < queue->engine_count; i++)
+		pthread_cond_signal(&queue->engines[i]->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	/* Engines finish the operations they have been given before exiting */
+	for (i = 0; i < queue->engine_count; i++) {
+		pthread_join(queue->engines[i]->tid, NULL);
+		pthread_cond_destroy(&queue->engines[i]->cond);
+		free(queue->engines[i]);
+	}
+
+	free(queue->engines);
+	close(queue->fd);
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+}
+
+int pdbg_async_submit(struct pdbg_async *queue, struct pdbg_async_op *op)
+{
+	struct async_engine *engine;
+
+	assert(op->target);
+
+	pthread_mutex_lock(&queue->lock);
+	engine = queue->stop ? NULL : async_engine_get(queue, async_bus(op->target));
+	if (!engine) {
+		pthread_mutex_unlock(&queue->lock);
+		return -1;
+	}
+
+	async_op_append(&engine->head, &engine->tail, op);
+	queue->outstanding++;
+	pthread_cond_signal(&engine->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+struct pdbg_async_op *pdbg_async_reap(struct pdbg_async *queue, bool wait)
+{
+	struct pdbg_async_op *op;
+	uint64_t count;
+
+	pthread_mutex_lock(&queue->lock);
+	while (wait && !queue->done_head && queue->outstanding)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+
+	op = async_op_pop(&queue->done_head, &queue->done_tail);
+	if (op) {
+		queue->outstanding--;
+		if (read(queue->fd, &count, sizeof(count)) != sizeof(count))
+			PR_ERROR("Unable to clear completion\n");
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return op;
+}
+
+int pdbg_async_outstanding(struct pdbg_async *queue)
+{
+	int count;
+
+	pthread_mutex_lock(&queue->lock);
+	count = queue->outstanding;
+	pthread_mutex_unlock(&queue->lock);
+
+	return count;
+}
+
+int pdbg_async_fd(struct pdbg_async *queue)
+{
+	return queue->fd;
+}
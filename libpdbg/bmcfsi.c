@@ -24,6 +24,7 @@
 #include <time.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include "bitutils.h"
 #include "operations.h"
@@ -93,6 +94,9 @@ static uint32_t clock_delay  = 0;
 static void *gpio_reg = NULL;
 static int mem_fd = 0;
 
+/* There is only a single bit-banged link so serialise all accesses to it */
+static pthread_mutex_t fsi_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void fsi_reset(struct fsi *fsi);
 
 static uint32_t readl(void *addr)
@@ -341,7 +345,7 @@ static enum fsi_result fsi_d_poll_wait(uint8_t slave_id, uint64_t *resp, int len
 	return rc;
 }
 
-static int fsi_getcfam(struct fsi *fsi, uint32_t addr, uint32_t *value)
+static int __fsi_getcfam(struct fsi *fsi, uint32_t addr, uint32_t *value)
 {
 	uint64_t seq;
 	uint64_t resp;
@@ -379,7 +383,7 @@ static int fsi_getcfam(struct fsi *fsi, uint32_t addr, uint32_t *value)
 	return rc;
 }
 
-static int fsi_putcfam(struct fsi *fsi, uint32_t addr, uint32_t data)
+static int __fsi_putcfam(struct fsi *fsi, uint32_t addr, uint32_t data)
 {
 	uint64_t seq;
 	uint64_t resp;
@@ -416,6 +420,29 @@ static int fsi_putcfam(struct fsi *fsi, uint32_t addr, uint32_t data)
 	return rc;
 }
 
+static int fsi_getcfam(struct fsi *fsi, uint32_t addr, uint32_t *value)
+{
+	int rc;
+
+	pthread_mutex_lock(&fsi_lock);
+	rc = __fsi_getcfam(fsi, addr, value);
+	pthread_mutex_unlock(&fsi_lock);
+
+	return rc;
+}
+
+static int fsi_putcfam(struct fsi *fsi, uint32_t addr, uint32_t data)
+{
+	int rc;
+
+	pthread_mutex_lock(&fsi_lock);
+	rc = __fsi_putcfam(fsi, addr, data);
+	pthread_mutex_unlock(&fsi_lock);
+
+	return rc;
+}
+
+/* Called with fsi_lock held */
 static void fsi_reset(struct fsi *fsi)
 {
 	uint32_t val;
@@ -423,9 +450,9 @@ static void fsi_reset(struct fsi *fsi)
 	fsi_break();
 
 	/* Clear own id on the master CFAM to access hMFSI ports */
-	fsi_getcfam(fsi, 0x800, &val);
+	__fsi_getcfam(fsi, 0x800, &val);
 	val &= ~(PPC_BIT32(6) | PPC_BIT32(7));
-	fsi_putcfam(fsi, 0x800, val);
+	__fsi_putcfam(fsi, 0x800, val);
 }
 
 void fsi_destroy(struct pdbg_target *target)
@@ -449,6 +476,8 @@ int bmcfsi_probe(struct pdbg_target *target)
 {
 	struct fsi *fsi = target_to_fsi(target);
 
+	/* The GPIOs are shared so only set them up once */
+	pthread_mutex_lock(&fsi_lock);
 	if (!mem_fd) {
 		mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
 		if (mem_fd < 0) {
@@ -498,6 +527,7 @@ int bmcfsi_probe(struct pdbg_target *target)
 
 		fsi_reset(fsi);
 	}
+	pthread_mutex_unlock(&fsi_lock);
 
 	return 0;
 }
@@ -18,11 +18,13 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include "target.h"
 #include "bitutils.h"
 #include "operations.h"
 #include "debug.h"
+#include "stats.h"
 
 #define FSI_DATA0_REG	0x0
 #define FSI_DATA1_REG	0x1
@@ -127,7 +129,7 @@ static struct pib fsi_pib = {
 };
 DECLARE_HW_UNIT(fsi_pib);
 
-static uint64_t opb_poll(struct opb *opb, uint32_t *read_data)
+static uint64_t __opb_poll(struct opb *opb, uint32_t *read_data)
 {
 	unsigned long retries = MFSI_OPB_MAX_TRIES;
 	uint64_t sval;
@@ -180,7 +182,21 @@ static uint64_t opb_poll(struct opb *opb, uint32_t *read_data)
 	return rc;
 }
 
-static int p8_opb_read(struct opb *opb, uint32_t addr, uint32_t *data)
+static uint64_t opb_poll(struct opb *opb, uint32_t *read_data)
+{
+	uint64_t start = stats_start();
+	uint64_t rc;
+
+	rc = __opb_poll(opb, read_data);
+	stats_record(&opb->target, PDBG_STAT_POLL, start, rc);
+	return rc;
+}
+
+/* An OPB access is a command write followed by polling for the result so
+ * accesses from different threads must not be interleaved */
+static pthread_mutex_t opb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int __p8_opb_read(struct opb *opb, uint32_t addr, uint32_t *data)
 {
 	uint64_t opb_cmd = OPB_CMD_READ | OPB_CMD_32BIT;
 	int64_t rc;
@@ -203,7 +219,7 @@ static int p8_opb_read(struct opb *opb, uint32_t addr, uint32_t *data)
 	return opb_poll(opb, data);
 }
 
-static int p8_opb_write(struct opb *opb, uint32_t addr, uint32_t data)
+static int __p8_opb_write(struct opb *opb, uint32_t addr, uint32_t data)
 {
 	uint64_t opb_cmd = OPB_CMD_WRITE | OPB_CMD_32BIT;
 	int64_t rc;
@@ -226,6 +242,28 @@ static int p8_opb_write(struct opb *opb, uint32_t addr, uint32_t data)
 	return opb_poll(opb, NULL);
 }
 
+static int p8_opb_read(struct opb *opb, uint32_t addr, uint32_t *data)
+{
+	int rc;
+
+	pthread_mutex_lock(&opb_lock);
+	rc = __p8_opb_read(opb, addr, data);
+	pthread_mutex_unlock(&opb_lock);
+
+	return rc;
+}
+
+static int p8_opb_write(struct opb *opb, uint32_t addr, uint32_t data)
+{
+	int rc;
+
+	pthread_mutex_lock(&opb_lock);
+	rc = __p8_opb_write(opb, addr, data);
+	pthread_mutex_unlock(&opb_lock);
+
+	return rc;
+}
+
 static struct opb p8_opb = {
 	.target = {
 		.name = "POWER8 OPB",
@@ -14,17 +14,20 @@
  * limitations under the License.
  */
 #include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ccan/array_size/array_size.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "target.h"
 #include "operations.h"
 #include "bitutils.h"
 #include "debug.h"
+#include "stats.h"
 
 uint64_t mfspr(uint64_t reg, uint64_t spr)
 {
@@ -110,11 +113,34 @@ struct thread_state thread_status(struct pdbg_target *target)
 {
 	struct thread *thread;
 
-	assert(!strcmp(target->class, "thread"));
+	assert(target->class_id == CLASS_THREAD);
 	thread = target_to_thread(target);
+
+	/* The thread status is only read once the core has been woken up */
+	if (target->parent->class_id == CLASS_CORE)
+		core_wakeup(target->parent);
+
 	return thread->status;
 }
 
+int thread_status_refresh(struct pdbg_target *target)
+{
+	struct core *core;
+	bool awake;
+
+	assert(target->class_id == CLASS_CORE);
+	core = target_to_core(target);
+
+	/* Waking the core up takes a fresh snapshot */
+	awake = __atomic_load_n(&core->awake, __ATOMIC_ACQUIRE);
+	CHECK_ERR(core_wakeup(target));
+	if (!awake || !core->thread_status ||
+	    pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+		return 0;
+
+	return core->thread_status(core);
+}
+
 /*
  * Single step the thread count instructions.
  */
@@ -122,7 +148,7 @@ int ram_step_thread(struct pdbg_target *thread_target, int count)
 {
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 	return thread->step(thread, count);
 }
@@ -131,7 +157,7 @@ int ram_start_thread(struct pdbg_target *thread_target)
 {
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 	return thread->start(thread);
 }
@@ -140,7 +166,7 @@ int ram_stop_thread(struct pdbg_target *thread_target)
 {
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 	return thread->stop(thread);
 }
@@ -149,11 +175,388 @@ int ram_sreset_thread(struct pdbg_target *thread_target)
 {
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 	return thread->sreset(thread);
 }
 
+/*
+ * Convert a mask of thread indexes on a core into a mask of hardware thread
+ * ids. Only enabled threads are included.
+ */
+static uint64_t core_thread_ids(struct pdbg_target *core_target, uint64_t thread_mask)
+{
+	struct pdbg_target *target;
+	uint64_t ids = 0;
+
+	pdbg_for_each_target("thread", core_target, target) {
+		if (!(thread_mask & (1ULL << pdbg_target_index(target))))
+			continue;
+
+		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		ids |= 1ULL << target_to_thread(target)->id;
+	}
+
+	return ids;
+}
+
+/*
+ * Start, stop or step the threads on a core with bit n of thread_mask set
+ * for thread index n. If the core supports it all the threads are
+ * controlled at once, otherwise each thread is controlled in turn.
+ */
+int ram_start_core(struct pdbg_target *core_target, uint64_t thread_mask)
+{
+	struct pdbg_target *target;
+	struct core *core;
+	int rc = 0;
+
+	assert(core_target->class_id == CLASS_CORE);
+	core = target_to_core(core_target);
+	if (core->start_threads)
+		return core->start_threads(core, core_thread_ids(core_target, thread_mask));
+
+	pdbg_for_each_target("thread", core_target, target) {
+		if (!(thread_mask & (1ULL << pdbg_target_index(target))))
+			continue;
+
+		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		rc |= ram_start_thread(target);
+	}
+
+	return rc;
+}
+
+int ram_stop_core(struct pdbg_target *core_target, uint64_t thread_mask)
+{
+	struct pdbg_target *target;
+	struct core *core;
+	int rc = 0;
+
+	assert(core_target->class_id == CLASS_CORE);
+	core = target_to_core(core_target);
+	if (core->stop_threads)
+		return core->stop_threads(core, core_thread_ids(core_target, thread_mask));
+
+	pdbg_for_each_target("thread", core_target, target) {
+		if (!(thread_mask & (1ULL << pdbg_target_index(target))))
+			continue;
+
+		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		rc |= ram_stop_thread(target);
+	}
+
+	return rc;
+}
+
+int ram_step_core(struct pdbg_target *core_target, uint64_t *thread_mask, int count)
+{
+	struct pdbg_target *target;
+	struct core *core;
+	uint64_t ids, index;
+	int rc = 0;
+
+	assert(core_target->class_id == CLASS_CORE);
+	core = target_to_core(core_target);
+	if (core->step_threads) {
+		ids = core_thread_ids(core_target, *thread_mask);
+		rc = core->step_threads(core, &ids, count);
+
+		/* Drop the threads the core couldn't step */
+		pdbg_for_each_target("thread", core_target, target) {
+			index = 1ULL << pdbg_target_index(target);
+			if ((*thread_mask & index) &&
+			    !(ids & (1ULL << target_to_thread(target)->id)))
+				*thread_mask &= ~index;
+		}
+
+		return rc;
+	}
+
+	pdbg_for_each_target("thread", core_target, target) {
+		index = 1ULL << pdbg_target_index(target);
+		if (!(*thread_mask & index))
+			continue;
+
+		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED ||
+		    ram_step_thread(target, count)) {
+			*thread_mask &= ~index;
+			rc = 1;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Stop the threads selected by thread_masks[i] on cores[i] with as little
+ * skew between cores as possible. The stop writes for every core are
+ * worked out first and then issued back to back before waiting for any of
+ * the threads to quiesce. Cores which don't support a two phase stop are
+ * stopped in turn after the others have been issued.
+ *
+ * If skew_ns is not NULL it returns the time between the first and last
+ * stop being issued.
+ */
+int ram_stop_cores(struct pdbg_target *cores[], uint64_t thread_masks[],
+		   int count, uint64_t *skew_ns)
+{
+	struct stop_write {
+		struct pdbg_target *pib;
+		uint64_t addr;
+		uint64_t value;
+		uint64_t ids;
+	} *writes;
+	uint64_t first = 0, last = 0;
+	int i, rc = 0;
+
+	writes = calloc(count, sizeof(*writes));
+	if (!writes)
+		return -1;
+
+	/* Wake the cores up together rather than one at a time as they are
+	 * first accessed below */
+	core_special_wakeup(cores, count);
+
+	/* Work out all the writes first */
+	for (i = 0; i < count; i++) {
+		struct core *core;
+
+		assert(cores[i]->class_id == CLASS_CORE);
+		core = target_to_core(cores[i]);
+		if (!core->stop_prepare || !core->stop_wait)
+			continue;
+
+		writes[i].ids = core_thread_ids(cores[i], thread_masks[i]);
+		if (core->stop_prepare(core, writes[i].ids, &writes[i].addr, &writes[i].value)) {
+			rc = -1;
+			continue;
+		}
+
+		if (writes[i].value)
+			writes[i].pib = pdbg_address_absolute(cores[i], &writes[i].addr);
+	}
+
+	/* Issue them back to back */
+	for (i = 0; i < count; i++) {
+		if (!writes[i].pib)
+			continue;
+
+		if (pib_write(writes[i].pib, writes[i].addr, writes[i].value)) {
+			writes[i].pib = NULL;
+			rc = -1;
+			continue;
+		}
+
+		last = stats_now();
+		if (!first)
+			first = last;
+	}
+
+	/* Stop the cores without a two phase stop */
+	for (i = 0; i < count; i++) {
+		struct core *core = target_to_core(cores[i]);
+
+		if (core->stop_prepare && core->stop_wait)
+			continue;
+
+		rc |= ram_stop_core(cores[i], thread_masks[i]);
+
+		last = stats_now();
+		if (!first)
+			first = last;
+	}
+
+	/* And only then wait for the threads to quiesce */
+	for (i = 0; i < count; i++) {
+		struct core *core = target_to_core(cores[i]);
+
+		if (!writes[i].pib)
+			continue;
+
+		rc |= core->stop_wait(core, writes[i].ids);
+	}
+
+	free(writes);
+
+	if (skew_ns)
+		*skew_ns = last - first;
+
+	return rc;
+}
+
+struct wakeup_group {
+	pthread_t tid;
+	bool started;
+	struct pdbg_target *pib;
+	struct core **cores;
+	int count;
+};
+
+/*
+ * Assert special wakeup on all cores in the group and then poll all of them
+ * together until they have all woken up or reached their backend's timeout.
+ * Cores another thread is already waking up are left to that thread.
+ */
+static void *core_wakeup_group(void *arg)
+{
+	struct wakeup_group *group = arg;
+	int i, rc, pending, elapsed;
+	bool *locked, *waiting;
+	uint64_t start;
+
+	locked = calloc(group->count, sizeof(*locked));
+	assert(locked);
+	waiting = calloc(group->count, sizeof(*waiting));
+	assert(waiting);
+
+	for (i = 0; i < group->count; i++) {
+		struct core *core = group->cores[i];
+
+		locked[i] = core_wakeup_begin(core, true);
+		if (!locked[i])
+			continue;
+
+		if (core->spwkup_assert(core))
+			PR_DEBUG("Unable to assert special wakeup on %s@0x%08" PRIx64 "\n",
+				 core->target.name,
+				 pdbg_target_address(&core->target, NULL));
+
+		waiting[i] = core->spwkup_asserted;
+	}
+
+	start = stats_start();
+	for (elapsed = 0; ; elapsed++) {
+		pending = 0;
+		for (i = 0; i < group->count; i++) {
+			struct core *core = group->cores[i];
+
+			if (!waiting[i])
+				continue;
+
+			rc = core->spwkup_done(core);
+			if (!rc && elapsed < core->spwkup_timeout) {
+				pending++;
+				continue;
+			}
+
+			/* Each core is timed until its own wakeup completes */
+			waiting[i] = false;
+			stats_record(&core->target, PDBG_STAT_POLL, start, rc <= 0);
+		}
+
+		if (!pending)
+			break;
+
+		usleep(1000);
+	}
+
+	/* Finish waking up each core now special wakeup has completed */
+	for (i = 0; i < group->count; i++) {
+		struct core *core = group->cores[i];
+
+		if (!locked[i])
+			continue;
+
+		if (core->spwkup_asserted && core->wakeup(core))
+			PR_ERROR("Unable to wake up %s@0x%08" PRIx64 "\n",
+				 core->target.name,
+				 pdbg_target_address(&core->target, NULL));
+		core_wakeup_end(core);
+	}
+
+	free(waiting);
+	free(locked);
+	return NULL;
+}
+
+/*
+ * Probe a set of cores and wake them up together. Special wakeup is asserted
+ * on every core before waiting for any of them, and cores on different chips
+ * are woken up in parallel. Cores which are already awake are left alone and
+ * cores without split special wakeup are woken up individually.
+ */
+void core_special_wakeup(struct pdbg_target *cores[], int count)
+{
+	struct wakeup_group *groups = NULL;
+	int i, j, ngroups = 0;
+
+	for (i = 0; i < count; i++) {
+		struct pdbg_target *target = cores[i];
+		struct core *core;
+		struct pdbg_target *pib;
+
+		assert(target->class_id == CLASS_CORE);
+		core = target_to_core(target);
+		if (!core->wakeup || !core->spwkup_assert || !core->spwkup_done)
+			continue;
+
+		if (__atomic_load_n(&core->awake, __ATOMIC_ACQUIRE))
+			continue;
+
+		if (pdbg_target_probe(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		pib = pdbg_target_parent("pib", target);
+		for (j = 0; j < ngroups; j++)
+			if (groups[j].pib == pib)
+				break;
+
+		if (j == ngroups) {
+			groups = realloc(groups, (ngroups + 1) * sizeof(*groups));
+			assert(groups);
+			memset(&groups[j], 0, sizeof(*groups));
+			groups[j].pib = pib;
+			ngroups++;
+		}
+
+		groups[j].cores = realloc(groups[j].cores,
+					  (groups[j].count + 1) * sizeof(*groups[j].cores));
+		assert(groups[j].cores);
+		groups[j].cores[groups[j].count++] = core;
+	}
+
+	/* One thread per chip */
+	for (i = 0; i < ngroups; i++) {
+		groups[i].started = ngroups > 1 &&
+			!pthread_create(&groups[i].tid, NULL, core_wakeup_group, &groups[i]);
+		if (!groups[i].started)
+			core_wakeup_group(&groups[i]);
+	}
+
+	for (i = 0; i < ngroups; i++) {
+		if (groups[i].started)
+			pthread_join(groups[i].tid, NULL);
+		free(groups[i].cores);
+	}
+	free(groups);
+
+	/* Wake up any remaining cores one at a time */
+	for (i = 0; i < count; i++) {
+		if (pdbg_target_probe(cores[i]) != PDBG_TARGET_ENABLED)
+			continue;
+
+		core_wakeup(cores[i]);
+	}
+}
+
+/* RAMs a single instruction, counting it in the thread's statistics */
+static int ram_instruction(struct thread *thread, uint64_t opcode, uint64_t *scratch)
+{
+	uint64_t start = stats_start();
+	int rc;
+
+	rc = thread->ram_instruction(thread, opcode, scratch);
+	stats_record(&thread->target, PDBG_STAT_RAM, start, rc);
+	return rc;
+}
+
 /*
  * RAMs the opcodes in *opcodes and store the results of each opcode
  * into *results. *results must point to an array the same size as
@@ -171,7 +574,7 @@ int ram_instructions(struct pdbg_target *thread_target, uint64_t *opcodes,
 	struct thread *thread;
 	bool did_setup = false;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 
 	if (!thread->ram_is_setup) {
@@ -200,7 +603,7 @@ int ram_instructions(struct pdbg_target *thread_target, uint64_t *opcodes,
 			opcode = mfspr(1, 277);
 		}
 
-		if (thread->ram_instruction(thread, opcode, &scratch)) {
+		if (ram_instruction(thread, opcode, &scratch)) {
 			PR_DEBUG("%s: %d, %016" PRIx64 "\n", __FUNCTION__, __LINE__, opcode);
 			exception = 1;
 			if (i >= 0 && i < len)
@@ -224,6 +627,208 @@ int ram_instructions(struct pdbg_target *thread_target, uint64_t *opcodes,
 	return exception;
 }
 
+/*
+ * A step session keeps a thread set up for both stepping and ramming so
+ * that many steps can be done, reading the NIA after each one, without
+ * setting up and tearing down either for every step.
+ */
+static int step_session_start(struct thread *thread)
+{
+	if (!thread->step_setup || !thread->step_once || !thread->step_destroy)
+		return -1;
+
+	CHECK_ERR(thread->step_setup(thread));
+
+	if (thread->ram_setup(thread)) {
+		thread->step_destroy(thread);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the NIA with the minimum number of instructions. Unlike
+ * ram_getnia() only r0 is saved and restored.
+ */
+static int step_session_getnia(struct thread *thread, uint64_t *nia)
+{
+	uint64_t r0 = 0, scratch = 0;
+	int rc = 0;
+
+	CHECK_ERR(ram_instruction(thread, mtspr(277, 0), &r0));
+
+	if (ram_instruction(thread, mfnia(0), &scratch) ||
+	    ram_instruction(thread, mtspr(277, 0), nia))
+		rc = -1;
+
+	/* Always try and restore r0 */
+	CHECK_ERR(ram_instruction(thread, mfspr(0, 277), &r0));
+
+	return rc;
+}
+
+static int step_session_end(struct thread *thread)
+{
+	int rc = 0;
+
+	if (thread->ram_destroy(thread))
+		rc = -1;
+
+	if (thread->step_destroy(thread))
+		rc = -1;
+
+	return rc;
+}
+
+static int addr_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Single step a quiesced thread until one of the conditions in until is
+ * met. The thread stays set up for stepping and ramming for the whole run
+ * so each step only costs the step itself plus reading the NIA.
+ *
+ * Returns the final NIA and the number of steps taken in nia and steps if
+ * they are not NULL.
+ */
+int ram_step_until(struct pdbg_target *thread_target,
+		   const struct thread_step_until *until,
+		   uint64_t *nia, uint64_t *steps)
+{
+	struct thread *thread;
+	uint64_t *addrs = NULL, cur_nia = 0, count = 0;
+	int rc = 0;
+
+	assert(thread_target->class_id == CLASS_THREAD);
+	thread = target_to_thread(thread_target);
+
+	if (thread->ram_is_setup)
+		return -1;
+
+	/* Without any condition this would never stop */
+	if (!until->naddrs && !until->range_end && !until->max_steps)
+		return -1;
+
+	if (until->naddrs) {
+		addrs = malloc(until->naddrs * sizeof(*addrs));
+		if (!addrs)
+			return -1;
+
+		memcpy(addrs, until->addrs, until->naddrs * sizeof(*addrs));
+		qsort(addrs, until->naddrs, sizeof(*addrs), addr_cmp);
+	}
+
+	if (step_session_start(thread)) {
+		free(addrs);
+		return -1;
+	}
+
+	while (!until->max_steps || count < until->max_steps) {
+		if (thread->step_once(thread) ||
+		    step_session_getnia(thread, &cur_nia)) {
+			rc = -1;
+			break;
+		}
+		count++;
+
+		if (addrs && bsearch(&cur_nia, addrs, until->naddrs,
+				     sizeof(*addrs), addr_cmp))
+			break;
+
+		if (until->range_end &&
+		    (cur_nia < until->range_start || cur_nia >= until->range_end))
+			break;
+	}
+
+	if (step_session_end(thread))
+		rc = -1;
+
+	free(addrs);
+
+	if (nia)
+		*nia = cur_nia;
+	if (steps)
+		*steps = count;
+
+	return rc;
+}
+
+/*
+ * Read the NIA and optionally all the GPRs in one go. Only r0 is used so it
+ * is saved first, which also gives GPR0, and restored last.
+ */
+static int step_session_getstate(struct thread *thread, uint64_t *nia, uint64_t *gprs)
+{
+	uint64_t r0 = 0, scratch = 0;
+	int i, rc = 0;
+
+	if (!gprs)
+		return step_session_getnia(thread, nia);
+
+	CHECK_ERR(ram_instruction(thread, mtspr(277, 0), &r0));
+	gprs[0] = r0;
+
+	for (i = 1; i < 32 && !rc; i++)
+		if (ram_instruction(thread, mtspr(277, i), &gprs[i]))
+			rc = -1;
+
+	if (!rc && (ram_instruction(thread, mfnia(0), &scratch) ||
+		    ram_instruction(thread, mtspr(277, 0), nia)))
+		rc = -1;
+
+	/* Always try and restore r0 */
+	CHECK_ERR(ram_instruction(thread, mfspr(0, 277), &r0));
+
+	return rc;
+}
+
+/*
+ * Single step a quiesced thread count times calling fn with the NIA (and
+ * the GPRs if gprs is true) before the first step and after every step.
+ * Stepping stops early if fn returns non-zero. The thread stays set up for
+ * stepping and ramming for the whole trace.
+ */
+int ram_step_trace(struct pdbg_target *thread_target, uint64_t count, bool gprs,
+		   pdbg_step_trace_fn fn, void *priv)
+{
+	struct thread *thread;
+	uint64_t nia, regs[32], i;
+	int rc = 0;
+
+	assert(thread_target->class_id == CLASS_THREAD);
+	thread = target_to_thread(thread_target);
+
+	if (thread->ram_is_setup)
+		return -1;
+
+	CHECK_ERR(step_session_start(thread));
+
+	for (i = 0; i <= count; i++) {
+		if (i && thread->step_once(thread)) {
+			rc = -1;
+			break;
+		}
+
+		if (step_session_getstate(thread, &nia, gprs ? regs : NULL)) {
+			rc = -1;
+			break;
+		}
+
+		if (fn(thread_target, nia, gprs ? regs : NULL, priv))
+			break;
+	}
+
+	if (step_session_end(thread))
+		rc = -1;
+
+	return rc;
+}
+
 /*
  * Get gpr value. Chip must be stopped.
  */
@@ -364,7 +969,7 @@ int ram_getxer(struct pdbg_target *thread_target, uint64_t *value)
 
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 
 	CHECK_ERR(thread->ram_getxer(thread_target, value));
@@ -376,7 +981,7 @@ int ram_putxer(struct pdbg_target *thread_target, uint64_t value)
 {
 	struct thread *thread;
 
-	assert(!strcmp(thread_target->class, "thread"));
+	assert(thread_target->class_id == CLASS_THREAD);
 	thread = target_to_thread(thread_target);
 
 	CHECK_ERR(thread->ram_putxer(thread_target, value));
@@ -391,146 +996,194 @@ int getring(struct pdbg_target *chiplet_target, uint64_t ring_addr, uint64_t rin
 {
 	struct chiplet *chiplet;
 
-	assert(!strcmp(chiplet_target->class, "chiplet"));
+	assert(chiplet_target->class_id == CLASS_CHIPLET);
 	chiplet = target_to_chiplet(chiplet_target);
 	return chiplet->getring(chiplet, ring_addr, ring_len, result);
 }
 
-int ram_state_thread(struct pdbg_target *thread, struct thread_regs *regs)
+enum thread_reg_type {
+	REG_SPR,
+	REG_NIA,
+	REG_MSR,
+	REG_CR,
+	REG_XER,
+	REG_GPRS,
+};
+
+struct thread_reg {
+	const char *name;
+	enum thread_reg_type type;
+	int spr;
+	size_t offset;
+	size_t size;
+	int digits;
+};
+
+#define THREAD_REG(_name, _type, _spr, _field, _digits)			\
+	{ .name = _name, .type = _type, .spr = _spr,				\
+	  .offset = offsetof(struct thread_regs, _field),			\
+	  .size = sizeof(((struct thread_regs *) 0)->_field),			\
+	  .digits = _digits }
+#define THREAD_SPR(_name, _spr, _field, _digits)				\
+	THREAD_REG(_name, REG_SPR, _spr, _field, _digits)
+
+/* The registers captured by ram_getregs() in the order they are printed */
+static const struct thread_reg thread_regs[] = {
+	THREAD_REG("NIA", REG_NIA, 0, nia, 16),
+	THREAD_SPR("CFAR", 28, cfar, 16),
+	THREAD_REG("MSR", REG_MSR, 0, msr, 16),
+	THREAD_SPR("LR", 8, lr, 16),
+	THREAD_SPR("CTR", 9, ctr, 16),
+	THREAD_SPR("TAR", 815, tar, 16),
+	THREAD_REG("CR", REG_CR, 0, cr, 8),
+	THREAD_REG("XER", REG_XER, 0, xer, 8),
+	THREAD_REG("GPRS", REG_GPRS, 0, gprs, 16),
+	THREAD_SPR("LPCR", 318, lpcr, 16),
+	THREAD_SPR("PTCR", 464, ptcr, 16),
+	THREAD_SPR("LPIDR", 319, lpidr, 16),
+	THREAD_SPR("PIDR", 48, pidr, 16),
+	THREAD_SPR("HFSCR", 190, hfscr, 16),
+	THREAD_SPR("HDSISR", 306, hdsisr, 8),
+	THREAD_SPR("HDAR", 307, hdar, 16),
+	THREAD_SPR("HEIR", 339, heir, 8),
+	THREAD_SPR("HID0", 1008, hid, 16),
+	THREAD_SPR("HSRR0", 314, hsrr0, 16),
+	THREAD_SPR("HSRR1", 315, hsrr1, 16),
+	THREAD_SPR("HDEC", 310, hdec, 16),
+	THREAD_SPR("HSPRG0", 304, hsprg0, 16),
+	THREAD_SPR("HSPRG1", 305, hsprg1, 16),
+	THREAD_SPR("FSCR", 153, fscr, 16),
+	THREAD_SPR("DSISR", 18, dsisr, 8),
+	THREAD_SPR("DAR", 19, dar, 16),
+	THREAD_SPR("SRR0", 26, srr0, 16),
+	THREAD_SPR("SRR1", 27, srr1, 16),
+	THREAD_SPR("DEC", 22, dec, 16),
+	THREAD_SPR("TB", 268, tb, 16),
+	THREAD_SPR("SPRG0", 272, sprg0, 16),
+	THREAD_SPR("SPRG1", 273, sprg1, 16),
+	THREAD_SPR("SPRG2", 274, sprg2, 16),
+	THREAD_SPR("SPRG3", 275, sprg3, 16),
+	THREAD_SPR("PPR", 896, ppr, 16),
+};
+
+/* Rams a single register into regs. Failures are ignored so that as much
+ * of the state as possible is captured. */
+static void ram_getreg(struct pdbg_target *thread, const struct thread_reg *reg,
+		       struct thread_regs *regs)
 {
-	struct thread_regs _regs;
-	struct thread *t;
+	void *field = (char *) regs + reg->offset;
 	uint64_t value = 0;
+	uint32_t cr = 0;
 	int i;
 
-	if (!regs)
-		regs = &_regs;
+	switch (reg->type) {
+	case REG_SPR:
+		ram_getspr(thread, reg->spr, &value);
+		break;
 
-	assert(!strcmp(thread->class, "thread"));
-	t = target_to_thread(thread);
+	case REG_NIA:
+		ram_getnia(thread, &value);
+		break;
 
-	CHECK_ERR(t->ram_setup(t));
+	case REG_MSR:
+		ram_getmsr(thread, &value);
+		break;
 
-	/*
-	 * It would be neat to do all the ramming up front, then go through
-	 * and print everything out somewhere else. In practice so far it
-	 * can help to diagnose checkstop issues with ramming to print as
-	 * we go. Once it's more robust and tested, maybe.
-	 */
-	ram_getnia(thread, &regs->nia);
-	printf("NIA   : 0x%016" PRIx64 "\n", regs->nia);
-
-	ram_getspr(thread, 28, &regs->cfar);
-	printf("CFAR  : 0x%016" PRIx64 "\n", regs->cfar);
-
-	ram_getmsr(thread, &regs->msr);
-	printf("MSR   : 0x%016" PRIx64 "\n", regs->msr);
-
-	ram_getspr(thread, 8, &regs->lr);
-	printf("LR    : 0x%016" PRIx64 "\n", regs->lr);
+	case REG_CR:
+		ram_getcr(thread, &cr);
+		value = cr;
+		break;
 
-	ram_getspr(thread, 9, &regs->ctr);
-	printf("CTR   : 0x%016" PRIx64 "\n", regs->ctr);
+	case REG_XER:
+		ram_getxer(thread, &value);
+		break;
 
-	ram_getspr(thread, 815, &regs->tar);
-	printf("TAR   : 0x%016" PRIx64 "\n", regs->tar);
-
-	ram_getcr(thread, &regs->cr);
-	printf("CR    : 0x%08" PRIx32 "\n", regs->cr);
-
-	ram_getxer(thread, &regs->xer);
-	printf("XER   : 0x%08" PRIx64 "\n", regs->xer);
-
-	printf("GPRS  :\n");
-	for (i = 0; i < 32; i++) {
-		ram_getgpr(thread, i, &regs->gprs[i]);
-		printf(" 0x%016" PRIx64 "", regs->gprs[i]);
-		if (i % 4 == 3)
-			printf("\n");
+	case REG_GPRS:
+		for (i = 0; i < 32; i++)
+			ram_getgpr(thread, i, &regs->gprs[i]);
+		return;
 	}
 
-	ram_getspr(thread, 318, &regs->lpcr);
-	printf("LPCR  : 0x%016" PRIx64 "\n", regs->lpcr);
-
-	ram_getspr(thread, 464, &regs->ptcr);
-	printf("PTCR  : 0x%016" PRIx64 "\n", regs->ptcr);
-
-	ram_getspr(thread, 319, &regs->lpidr);
-	printf("LPIDR : 0x%016" PRIx64 "\n", regs->lpidr);
-
-	ram_getspr(thread, 48, &regs->pidr);
-	printf("PIDR  : 0x%016" PRIx64 "\n", regs->pidr);
-
-	ram_getspr(thread, 190, &regs->hfscr);
-	printf("HFSCR : 0x%016" PRIx64 "\n", regs->hfscr);
-
-	ram_getspr(thread, 306, &value);
-	regs->hdsisr = value;
-	printf("HDSISR: 0x%08" PRIx32 "\n", regs->hdsisr);
-
-	ram_getspr(thread, 307, &regs->hdar);
-	printf("HDAR  : 0x%016" PRIx64 "\n", regs->hdar);
-
-	ram_getspr(thread, 339, &value);
-	regs->heir = value;
-	printf("HEIR : 0x%016" PRIx32 "\n", regs->heir);
-
-	ram_getspr(thread, 1008, &regs->hid);
-	printf("HID0 : 0x%016" PRIx64 "\n", regs->hid);
-
-	ram_getspr(thread, 314, &regs->hsrr0);
-	printf("HSRR0 : 0x%016" PRIx64 "\n", regs->hsrr0);
-
-	ram_getspr(thread, 315, &regs->hsrr1);
-	printf("HSRR1 : 0x%016" PRIx64 "\n", regs->hsrr1);
-
-	ram_getspr(thread, 310, &regs->hdec);
-	printf("HDEC  : 0x%016" PRIx64 "\n", regs->hdec);
+	if (reg->size == sizeof(uint32_t))
+		*(uint32_t *) field = value;
+	else
+		*(uint64_t *) field = value;
+}
 
-	ram_getspr(thread, 304, &regs->hsprg0);
-	printf("HSPRG0: 0x%016" PRIx64 "\n", regs->hsprg0);
+static void print_reg(const struct thread_reg *reg, const struct thread_regs *regs)
+{
+	const void *field = (const char *) regs + reg->offset;
+	uint64_t value;
+	int i;
 
-	ram_getspr(thread, 305, &regs->hsprg1);
-	printf("HSPRG1: 0x%016" PRIx64 "\n", regs->hsprg1);
+	if (reg->type == REG_GPRS) {
+		printf("GPRS  :\n");
+		for (i = 0; i < 32; i++) {
+			printf(" 0x%016" PRIx64 "", regs->gprs[i]);
+			if (i % 4 == 3)
+				printf("\n");
+		}
+		return;
+	}
 
-	ram_getspr(thread, 153, &regs->fscr);
-	printf("FSCR  : 0x%016" PRIx64 "\n", regs->fscr);
+	if (reg->size == sizeof(uint32_t))
+		value = *(const uint32_t *) field;
+	else
+		value = *(const uint64_t *) field;
 
-	ram_getspr(thread, 18, &value);
-	regs->dsisr = value;
-	printf("DSISR : 0x%08" PRIx32 "\n", regs->dsisr);
+	printf("%-6s: 0x%0*" PRIx64 "\n", reg->name, reg->digits, value);
+}
 
-	ram_getspr(thread, 19, &regs->dar);
-	printf("DAR   : 0x%016" PRIx64 "\n", regs->dar);
+static int ram_regs(struct pdbg_target *thread, struct thread_regs *regs, bool print)
+{
+	struct thread *t;
+	int i;
 
-	ram_getspr(thread, 26, &regs->srr0);
-	printf("SRR0  : 0x%016" PRIx64 "\n", regs->srr0);
+	assert(thread->class_id == CLASS_THREAD);
+	t = target_to_thread(thread);
 
-	ram_getspr(thread, 27, &regs->srr1);
-	printf("SRR1  : 0x%016" PRIx64 "\n", regs->srr1);
+	CHECK_ERR(t->ram_setup(t));
 
-	ram_getspr(thread, 22, &regs->dec);
-	printf("DEC   : 0x%016" PRIx64 "\n", regs->dec);
+	for (i = 0; i < ARRAY_SIZE(thread_regs); i++) {
+		ram_getreg(thread, &thread_regs[i], regs);
+		if (print)
+			print_reg(&thread_regs[i], regs);
+	}
 
-	ram_getspr(thread, 268, &regs->tb);
-	printf("TB    : 0x%016" PRIx64 "\n", regs->tb);
+	CHECK_ERR(t->ram_destroy(t));
 
-	ram_getspr(thread, 272, &regs->sprg0);
-	printf("SPRG0 : 0x%016" PRIx64 "\n", regs->sprg0);
+	return 0;
+}
 
-	ram_getspr(thread, 273, &regs->sprg1);
-	printf("SPRG1 : 0x%016" PRIx64 "\n", regs->sprg1);
+int ram_state_thread(struct pdbg_target *thread, struct thread_regs *regs)
+{
+	struct thread_regs _regs;
 
-	ram_getspr(thread, 274, &regs->sprg2);
-	printf("SPRG2 : 0x%016" PRIx64 "\n", regs->sprg2);
+	if (!regs)
+		regs = &_regs;
 
-	ram_getspr(thread, 275, &regs->sprg3);
-	printf("SPRG3 : 0x%016" PRIx64 "\n", regs->sprg3);
+	/*
+	 * Print each register as soon as it has been rammed rather than
+	 * capturing them all first. In practice so far it can help to
+	 * diagnose checkstop issues with ramming to print as we go.
+	 */
+	return ram_regs(thread, regs, true);
+}
 
-	ram_getspr(thread, 896, &regs->ppr);
-	printf("PPR   : 0x%016" PRIx64 "\n", regs->ppr);
+/*
+ * Same as ram_state_thread() but only captures the registers without
+ * printing them, which allows threads on different chips to be captured
+ * concurrently and printed afterwards with ram_print_regs().
+ */
+int ram_getregs(struct pdbg_target *thread, struct thread_regs *regs)
+{
+	return ram_regs(thread, regs, false);
+}
 
-	CHECK_ERR(t->ram_destroy(t));
+void ram_print_regs(const struct thread_regs *regs)
+{
+	int i;
 
-	return 0;
+	for (i = 0; i < ARRAY_SIZE(thread_regs); i++)
+		print_reg(&thread_regs[i], regs);
 }
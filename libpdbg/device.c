@@ -24,12 +24,13 @@
 #include <ccan/short_types/short_types.h>
 #include <ccan/str/str.h>
 #include <endian.h>
+#include <pthread.h>
 
 #include "debug.h"
 #include "compiler.h"
+#include "hash.h"
 
 #define prerror printf
-#define is_rodata(p) false
 
 #define dt_for_each_child(parent, node) \
 	list_for_each(&parent->children, node, list)
@@ -38,72 +39,117 @@
 static uint32_t last_phandle = 0;
 
 static struct pdbg_target *pdbg_dt_root;
+static const void *pdbg_dt_fdt;
 
 /*
- * An in-memory representation of a node in the device tree.
+ * In lazy mode the children of a node are only created from the FDT the
+ * first time something walks them. Until then the node just records where
+ * it is in the FDT.
  *
- * This is trivially flattened into an fdt.
+ * dt_lock is held for writing while nodes or properties are added and for
+ * reading while properties are looked up, as both share the property
+ * lists and the interned names.
+ */
+static bool dt_lazy;
+static pthread_rwlock_t dt_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * The expanded tree is never freed so nodes and properties are carved out of
+ * large blocks instead of being allocated one at a time.
+ */
+#define DT_ARENA_BLOCK_SIZE	(64 * 1024)
+#define DT_ARENA_ALIGN		16
+
+static char *dt_arena_next;
+static size_t dt_arena_left;
+
+static void *dt_alloc(size_t size)
+{
+	size_t block;
+	void *p;
+
+	size = (size + DT_ARENA_ALIGN - 1) & ~(DT_ARENA_ALIGN - 1);
+	if (size > dt_arena_left) {
+		block = size > DT_ARENA_BLOCK_SIZE ? size : DT_ARENA_BLOCK_SIZE;
+		dt_arena_next = calloc(1, block);
+		if (!dt_arena_next) {
+			prerror("Failed to allocate device tree memory\n");
+			abort();
+		}
+		dt_arena_left = block;
+	}
+
+	p = dt_arena_next;
+	dt_arena_next += size;
+	dt_arena_left -= size;
+
+	return p;
+}
+
+/*
+ * An in-memory representation of a node in the device tree.
  *
- * Note that the add_* routines will make a copy of the name if it's not
- * a read-only string (ie. usually a string literal).
+ * The FDT the tree is expanded from must stay around as the names and
+ * values of nodes and properties from it are not copied. A property value
+ * is only copied the first time it is changed.
  */
 struct dt_property {
 	struct list_node list;
+	const struct pdbg_target *node;
 	const char *name;
 	size_t len;
-	char prop[/* len */];
+	const void *prop;
+	bool copied;
 };
 
-static const char *take_name(const char *name)
+/*
+ * Property names are interned so a node's properties can be compared by
+ * pointer. Nodes only have a handful of properties so walking the list is
+ * cheaper than keeping a table of every property in the tree.
+ */
+
+/* Returns the hardware unit for the FDT node at node_offset if there is one */
+static struct hw_unit_info *dt_find_hw_unit(const void *fdt, int node_offset)
 {
-	if (!is_rodata(name) && !(name = strdup(name))) {
-		prerror("Failed to allocate copy of name");
-		abort();
+	const struct fdt_property *prop;
+	struct hw_unit_info *hw_info;
+	int i, prop_len;
+
+	prop = fdt_get_property(fdt, node_offset, "compatible", NULL);
+	if (!prop)
+		return NULL;
+
+	/*
+	 * If I understand correctly, the property we have
+	 * here can be a stringlist with a few compatible
+	 * strings
+	 */
+	prop_len = fdt32_to_cpu(prop->len);
+	i = 0;
+	while (i < prop_len) {
+		hw_info = find_compatible_target(&prop->data[i]);
+		if (hw_info)
+			return hw_info;
+
+		i += strlen(&prop->data[i]) + 1;
 	}
-	return name;
-}
 
-static void free_name(const char *name)
-{
-	if (!is_rodata(name))
-		free((char *)name);
+	return NULL;
 }
 
 static struct pdbg_target *dt_new_node(const char *name, const void *fdt, int node_offset)
 {
 	struct hw_unit_info *hw_info = NULL;
-	const struct fdt_property *prop;
 	struct pdbg_target *node;
 	size_t size = sizeof(*node);
 
 	if (fdt) {
-		prop = fdt_get_property(fdt, node_offset, "compatible", NULL);
-		if (prop) {
-			int i, prop_len = fdt32_to_cpu(prop->len);
-
-			/*
-			 * If I understand correctly, the property we have
-			 * here can be a stringlist with a few compatible
-			 * strings
-			 */
-			i = 0;
-			while (i < prop_len) {
-				hw_info = find_compatible_target(&prop->data[i]);
-				if (hw_info) {
-					size = hw_info->size;
-					break;
-				}
-
-				i += strlen(&prop->data[i]) + 1;
-			}
-		}
+		hw_info = dt_find_hw_unit(fdt, node_offset);
+		if (hw_info)
+			size = hw_info->size;
 	}
 
-	node = calloc(1, size);
-	if (!node) {
-		prerror("Failed to allocate node\n");
-		abort();
-	}
+	node = dt_alloc(size);
 
 	if (hw_info) {
 		struct pdbg_target_class *target_class;
@@ -114,15 +160,17 @@ static struct pdbg_target *dt_new_node(const char *name, const void *fdt, int no
 		 * above DECLARE_HW_UNIT). */
 		memcpy(node, hw_info->hw_unit, size);
 		target_class = get_target_class(node->class);
+		node->class_id = target_class->id;
 		list_add_tail(&target_class->targets, &node->class_link);
 	}
 
-	node->dn_name = take_name(name);
+	node->dn_name = name;
+	node->fdt_offset = node_offset;
 	node->parent = NULL;
 	list_head_init(&node->properties);
 	list_head_init(&node->children);
-	/* FIXME: locking? */
-	node->phandle = ++last_phandle;
+	pthread_mutex_init(&node->lock, NULL);
+	node->phandle = __atomic_add_fetch(&last_phandle, 1, __ATOMIC_RELAXED);
 	return node;
 }
 
@@ -172,6 +220,15 @@ static bool dt_attach_root(struct pdbg_target *parent, struct pdbg_target *root)
 		return true;
 	}
 
+	/* Nodes usually come from the FDT already in order */
+	node = list_tail(&parent->children, struct pdbg_target, list);
+	if (dt_cmp_subnodes(node, root) < 0) {
+		list_add_tail(&parent->children, &root->list);
+		root->parent = parent;
+
+		return true;
+	}
+
 	dt_for_each_child(parent, node) {
 		int cmp = dt_cmp_subnodes(node, root);
 
@@ -194,15 +251,6 @@ static bool dt_attach_root(struct pdbg_target *parent, struct pdbg_target *root)
 	return true;
 }
 
-static inline void dt_destroy(struct pdbg_target *dn)
-{
-	if (!dn)
-		return;
-
-	free_name(dn->dn_name);
-	free(dn);
-}
-
 static char *dt_get_path(const struct pdbg_target *node)
 {
 	unsigned int len = 0;
@@ -281,6 +329,7 @@ static struct pdbg_target *dt_find_by_path(struct pdbg_target *root, const char
 
 		/* Compare with each child node */
 		match = false;
+		dt_expand_children(root);
 		list_for_each(&root->children, n, list) {
 			match = true;
 			__dt_path_split(n->dn_name, &nn, &nnl, &na, &nal);
@@ -301,48 +350,89 @@ static struct pdbg_target *dt_find_by_path(struct pdbg_target *root, const char
 	return root;
 }
 
+/* Called with dt_lock held */
+static struct dt_property *__dt_find_property(const struct pdbg_target *node,
+					     const char *name)
+{
+	struct dt_property *p;
+
+	/* No node has a property which has never been named */
+	name = str_interned(name);
+	if (!name)
+		return NULL;
+
+	list_for_each(&node->properties, p, list)
+		if (p->name == name)
+			return p;
+
+	return NULL;
+}
+
 static struct dt_property *dt_find_property(const struct pdbg_target *node,
 					   const char *name)
 {
-	struct dt_property *i;
+	struct dt_property *p;
 
-	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
-			return i;
-	return NULL;
+	pthread_rwlock_rdlock(&dt_lock);
+	p = __dt_find_property(node, name);
+	pthread_rwlock_unlock(&dt_lock);
+
+	return p;
 }
 
 static struct dt_property *new_property(struct pdbg_target *node,
-					const char *name, size_t size)
+					const char *name, bool fdt_name)
 {
-	struct dt_property *p = malloc(sizeof(*p) + size);
+	struct dt_property *p;
 	char *path;
 
-	if (!p) {
-		path = dt_get_path(node);
-		prerror("Failed to allocate property \"%s\" for %s of %zu bytes\n",
-			name, path, size);
-		free(path);
-		abort();
-	}
-	if (dt_find_property(node, name)) {
+	name = fdt_name ? str_intern_static(name) : str_intern(name);
+	list_for_each(&node->properties, p, list) {
+		if (p->name != name)
+			continue;
+
 		path = dt_get_path(node);
 		prerror("Duplicate property \"%s\" in node %s\n",
 			name, path);
 		free(path);
 		abort();
-
 	}
 
-	p->name = take_name(name);
-	p->len = size;
+	p = dt_alloc(sizeof(*p));
+	p->node = node;
+	p->name = name;
 	list_add_tail(&node->properties, &p->list);
 	return p;
 }
 
+/* Gives the property its own copy of its value with room for len bytes */
+static void dt_copy_property(struct dt_property *p, size_t len)
+{
+	void *prop;
+	char *path;
+
+	prop = malloc(len ? len : 1);
+	if (!prop) {
+		path = dt_get_path(p->node);
+		prerror("Failed to allocate property \"%s\" for %s of %zu bytes\n",
+			p->name, path, len);
+		free(path);
+		abort();
+	}
+
+	memcpy(prop, p->prop, p->len < len ? p->len : len);
+	if (p->copied)
+		free((void *)p->prop);
+
+	p->prop = prop;
+	p->copied = true;
+}
+
+/* Properties from the FDT refer to it directly while others are copied */
 static struct dt_property *dt_add_property(struct pdbg_target *node,
 				    const char *name,
-				    const void *val, size_t size)
+				    const void *val, size_t size,
+				    bool from_fdt)
 {
 	struct dt_property *p;
 
@@ -352,44 +442,43 @@ static struct dt_property *dt_add_property(struct pdbg_target *node,
 	 */
 	if (strcmp(name, "linux,phandle") == 0 ||
 	    strcmp(name, "phandle") == 0) {
+		uint32_t last = __atomic_load_n(&last_phandle, __ATOMIC_RELAXED);
+
 		assert(size == 4);
 		node->phandle = *(const u32 *)val;
-		if (node->phandle >= last_phandle)
-			last_phandle = node->phandle;
+		while (node->phandle > last &&
+		       !__atomic_compare_exchange_n(&last_phandle, &last, node->phandle,
+						    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 		return NULL;
 	}
 
-	p = new_property(node, name, size);
-	if (size)
-		memcpy(p->prop, val, size);
-	return p;
-}
-
-static void dt_resize_property(struct dt_property **prop, size_t len)
-{
-	size_t new_len = sizeof(**prop) + len;
-
-	*prop = realloc(*prop, new_len);
+	p = new_property(node, name, from_fdt);
+	p->len = size;
+	p->prop = val;
+	if (!from_fdt && size)
+		dt_copy_property(p, size);
 
-	/* Fix up linked lists in case we moved. (note: not an empty list). */
-	(*prop)->list.next->prev = &(*prop)->list;
-	(*prop)->list.prev->next = &(*prop)->list;
+	return p;
 }
 
 void pdbg_target_set_property(struct pdbg_target *target, const char *name, const void *val, size_t size)
 {
 	struct dt_property *p;
 
-	if ((p = dt_find_property(target, name))) {
-		if (size > p->len) {
-			dt_resize_property(&p, size);
-			p->len = size;
+	pthread_rwlock_wrlock(&dt_lock);
+	if ((p = __dt_find_property(target, name))) {
+		/* Properties still in the FDT are copied before being changed */
+		if (!p->copied || size > p->len) {
+			dt_copy_property(p, size > p->len ? size : p->len);
+			if (size > p->len)
+				p->len = size;
 		}
 
-		memcpy(p->prop, val, size);
+		memcpy((void *)p->prop, val, size);
 	} else {
-		dt_add_property(target, name, val, size);
+		dt_add_property(target, name, val, size, false);
 	}
+	pthread_rwlock_unlock(&dt_lock);
 }
 
 void *pdbg_target_property(struct pdbg_target *target, const char *name, size_t *size)
@@ -400,7 +489,7 @@ void *pdbg_target_property(struct pdbg_target *target, const char *name, size_t
 	if (p) {
 		if (size)
 			*size = p->len;
-		return p->prop;
+		return (void *)p->prop;
 	} else if (size)
 		*size = 0;
 
@@ -415,16 +504,18 @@ static u32 dt_property_get_cell(const struct dt_property *prop, u32 index)
 }
 
 /* First child of this node. */
-static struct pdbg_target *dt_first(const struct pdbg_target *root)
+static struct pdbg_target *dt_first(struct pdbg_target *root)
 {
+	dt_expand_children(root);
 	return list_top(&root->children, struct pdbg_target, list);
 }
 
 /* Return next node, or NULL. */
 static struct pdbg_target *dt_next(const struct pdbg_target *root,
-			const struct pdbg_target *prev)
+			struct pdbg_target *prev)
 {
 	/* Children? */
+	dt_expand_children(prev);
 	if (!list_empty(&prev->children))
 		return dt_first(prev);
 
@@ -531,47 +622,66 @@ static enum pdbg_target_status str_to_status(const char *status)
 		assert(0);
 }
 
-static int dt_expand_node(struct pdbg_target *node, const void *fdt, int fdt_node)
+static void dt_expand_property(struct pdbg_target *node, const struct fdt_property *prop)
 {
-	const struct fdt_property *prop;
-	int offset, nextoffset, err;
-	struct pdbg_target *child;
 	const char *name;
-	uint32_t tag;
 	uint32_t data;
 
-	if (((err = fdt_check_header(fdt)) != 0)
-	    || (fdt_node < 0) || (fdt_node % FDT_TAGSIZE)
-	    || (fdt_next_tag(fdt, fdt_node, &fdt_node) != FDT_BEGIN_NODE)) {
-		prerror("FDT: Error %d parsing node 0x%x\n", err, fdt_node);
-		return -1;
+	name = fdt_string(pdbg_dt_fdt, fdt32_to_cpu(prop->nameoff));
+	if (strcmp("index", name) == 0) {
+		memcpy(&data, prop->data, sizeof(data));
+		node->index = fdt32_to_cpu(data);
 	}
 
-	nextoffset = fdt_node;
-	do {
-		offset = nextoffset;
+	if (strcmp("status", name) == 0)
+		node->status = str_to_status(prop->data);
 
-		tag = fdt_next_tag(fdt, offset, &nextoffset);
-		switch (tag) {
-		case FDT_PROP:
-			prop = fdt_offset_ptr(fdt, offset, 0);
-			name = fdt_string(fdt, fdt32_to_cpu(prop->nameoff));
-			if (strcmp("index", name) == 0) {
-				memcpy(&data, prop->data, sizeof(data));
-				node->index = fdt32_to_cpu(data);
-			}
+	dt_add_property(node, name, prop->data,
+			fdt32_to_cpu(prop->len), true);
+}
 
-			if (strcmp("status", name) == 0)
-				node->status = str_to_status(prop->data);
+static void dt_expand_properties(struct pdbg_target *node)
+{
+	int offset;
 
-			dt_add_property(node, name, prop->data,
-					fdt32_to_cpu(prop->len));
-			break;
-		case FDT_BEGIN_NODE:
-			name = fdt_get_name(fdt, offset, NULL);
-			child = dt_new_node(name, fdt, offset);
+	fdt_for_each_property_offset(offset, pdbg_dt_fdt, node->fdt_offset)
+		dt_expand_property(node,
+			fdt_get_property_by_offset(pdbg_dt_fdt, offset, NULL));
+}
+
+/*
+ * The expanded flags are set once everything they cover has been created so
+ * they can be checked without taking dt_lock.
+ */
+static bool dt_expanded(const struct pdbg_target *node)
+{
+	return __atomic_load_n(&node->expanded, __ATOMIC_ACQUIRE);
+}
+
+static bool dt_subtree_expanded(const struct pdbg_target *node)
+{
+	return __atomic_load_n(&node->subtree_expanded, __ATOMIC_ACQUIRE);
+}
+
+/* Creates the children of node from the FDT if that hasn't been done yet */
+void dt_expand_children(struct pdbg_target *node)
+{
+	struct pdbg_target *child;
+	const char *name;
+	bool added;
+	int offset;
+
+	if (dt_expanded(node))
+		return;
+
+	pthread_rwlock_wrlock(&dt_lock);
+	if (!node->expanded) {
+		added = false;
+		fdt_for_each_subnode(offset, pdbg_dt_fdt, node->fdt_offset) {
+			name = fdt_get_name(pdbg_dt_fdt, offset, NULL);
+			child = dt_new_node(name, pdbg_dt_fdt, offset);
 			assert(child);
-			nextoffset = dt_expand_node(child, fdt, offset);
+			dt_expand_properties(child);
 
 			/*
 			 * This may fail in case of duplicate, keep it
@@ -579,21 +689,249 @@ static int dt_expand_node(struct pdbg_target *node, const void *fdt, int fdt_nod
 			 * assert
 			 */
 			(void)dt_attach_root(node, child);
+			added = true;
+		}
+		__atomic_store_n(&node->expanded, true, __ATOMIC_RELEASE);
+
+		/* The new children are only walked once node is expanded */
+		if (added)
+			target_class_index_invalidate();
+	}
+	pthread_rwlock_unlock(&dt_lock);
+}
+
+/*
+ * Creates everything below a node none of whose children have been created
+ * in a single pass over its part of the FDT. Properties of the node itself
+ * are only added if props is set. Returns the offset following the node.
+ * Called with dt_lock held.
+ */
+static int dt_expand_fdt_subtree(struct pdbg_target *node, bool props)
+{
+	struct pdbg_target *child;
+	int offset, next;
+	uint32_t tag;
+
+	tag = fdt_next_tag(pdbg_dt_fdt, node->fdt_offset, &next);
+	assert(tag == FDT_BEGIN_NODE);
+
+	do {
+		offset = next;
+		tag = fdt_next_tag(pdbg_dt_fdt, offset, &next);
+		switch (tag) {
+		case FDT_PROP:
+			if (props)
+				dt_expand_property(node, fdt_offset_ptr(pdbg_dt_fdt, offset, 0));
+			break;
+
+		case FDT_BEGIN_NODE:
+			child = dt_new_node(fdt_get_name(pdbg_dt_fdt, offset, NULL),
+					    pdbg_dt_fdt, offset);
+			assert(child);
+			next = dt_expand_fdt_subtree(child, true);
+
+			/* As in dt_expand_children() duplicates are dropped */
+			(void)dt_attach_root(node, child);
 			break;
-		case FDT_END:
-			return -1;
 		}
-	} while (tag != FDT_END_NODE);
+	} while (tag != FDT_END_NODE && tag != FDT_END);
+
+	assert(tag == FDT_END_NODE);
 
-	return nextoffset;
+	__atomic_store_n(&node->expanded, true, __ATOMIC_RELEASE);
+	__atomic_store_n(&node->subtree_expanded, true, __ATOMIC_RELEASE);
+
+	return next;
 }
 
-static void dt_expand(const void *fdt)
+/* Creates every node below node which hasn't been created yet */
+void dt_expand_subtree(struct pdbg_target *node)
 {
-	PR_DEBUG("FDT: Parsing fdt @%p\n", fdt);
+	struct pdbg_target *child;
 
-	if (dt_expand_node(pdbg_dt_root, fdt, 0) < 0)
-		abort();
+	if (dt_subtree_expanded(node))
+		return;
+
+	/* Nothing below node exists yet so the FDT is walked just once */
+	if (!dt_expanded(node)) {
+		pthread_rwlock_wrlock(&dt_lock);
+		if (!node->expanded) {
+			dt_expand_fdt_subtree(node, false);
+			target_class_index_invalidate();
+		}
+		pthread_rwlock_unlock(&dt_lock);
+	}
+
+	dt_for_each_child(node, child)
+		dt_expand_subtree(child);
+
+	__atomic_store_n(&node->subtree_expanded, true, __ATOMIC_RELEASE);
+}
+
+/*
+ * The classes of the targets below each FDT node, so that subtrees without
+ * any targets of a class can be skipped without creating them or walking
+ * the FDT again. Built by a single walk of the FDT the first time it is
+ * needed. The nodes are in FDT order so they are sorted by offset.
+ */
+struct dt_fdt_node {
+	int offset;
+	bool children;
+	uint64_t classes;
+};
+
+static struct dt_fdt_node *dt_fdt_nodes;
+static int dt_fdt_node_count;
+static pthread_mutex_t dt_fdt_nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void dt_fdt_nodes_build(void)
+{
+	struct dt_fdt_node *nodes = NULL;
+	struct hw_unit_info *hw_info;
+	uint64_t *own = NULL;
+	int *stack = NULL;
+	int offset, depth = 0, count = 0, size = 0, sp = 0, i;
+
+	for (offset = 0; offset >= 0 && depth >= 0;
+	     offset = fdt_next_node(pdbg_dt_fdt, offset, &depth)) {
+		if (count == size) {
+			size = size ? size * 2 : 256;
+			nodes = realloc(nodes, size * sizeof(*nodes));
+			own = realloc(own, size * sizeof(*own));
+			stack = realloc(stack, size * sizeof(*stack));
+			assert(nodes && own && stack);
+		}
+
+		/* Nodes at this depth or deeper are finished, add their
+		 * classes to their parents */
+		while (sp > depth) {
+			i = stack[--sp];
+			if (sp)
+				nodes[stack[sp - 1]].classes |= nodes[i].classes | own[i];
+		}
+
+		hw_info = dt_find_hw_unit(pdbg_dt_fdt, offset);
+		own[count] = hw_info ?
+			target_class_bit(((struct pdbg_target *) hw_info->hw_unit)->class) : 0;
+		nodes[count].offset = offset;
+		nodes[count].children = false;
+		nodes[count].classes = 0;
+		if (sp)
+			nodes[stack[sp - 1]].children = true;
+		stack[sp++] = count++;
+	}
+
+	while (sp) {
+		i = stack[--sp];
+		if (sp)
+			nodes[stack[sp - 1]].classes |= nodes[i].classes | own[i];
+	}
+
+	free(own);
+	free(stack);
+
+	dt_fdt_node_count = count;
+	__atomic_store_n(&dt_fdt_nodes, nodes, __ATOMIC_RELEASE);
+}
+
+static const struct dt_fdt_node *dt_fdt_node(const struct pdbg_target *node)
+{
+	struct dt_fdt_node *nodes;
+	int lo = 0, hi, mid;
+
+	nodes = __atomic_load_n(&dt_fdt_nodes, __ATOMIC_ACQUIRE);
+	if (!nodes) {
+		pthread_mutex_lock(&dt_fdt_nodes_lock);
+		if (!dt_fdt_nodes)
+			dt_fdt_nodes_build();
+		nodes = dt_fdt_nodes;
+		pthread_mutex_unlock(&dt_fdt_nodes_lock);
+	}
+
+	hi = dt_fdt_node_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (nodes[mid].offset < node->fdt_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	assert(lo < dt_fdt_node_count && nodes[lo].offset == node->fdt_offset);
+	return &nodes[lo];
+}
+
+/* Looks for a target of the given class below the FDT node at node_offset */
+static bool dt_fdt_contains_class(int node_offset, const char *klass)
+{
+	struct hw_unit_info *hw_info;
+	int offset, depth = 0;
+
+	for (offset = fdt_next_node(pdbg_dt_fdt, node_offset, &depth);
+	     offset >= 0 && depth > 0;
+	     offset = fdt_next_node(pdbg_dt_fdt, offset, &depth)) {
+		hw_info = dt_find_hw_unit(pdbg_dt_fdt, offset);
+		if (hw_info && !strcmp(((struct pdbg_target *) hw_info->hw_unit)->class, klass))
+			return true;
+	}
+
+	return false;
+}
+
+static void __dt_expand_class(struct pdbg_target *node, uint64_t class_bit)
+{
+	const struct dt_fdt_node *fdt_node;
+	struct pdbg_target *child;
+	bool subtree = true;
+
+	if (dt_subtree_expanded(node) ||
+	    (__atomic_load_n(&node->expanded_classes, __ATOMIC_ACQUIRE) & class_bit))
+		return;
+
+	fdt_node = dt_fdt_node(node);
+	if (!fdt_node->children) {
+		dt_expand_children(node);
+		__atomic_store_n(&node->subtree_expanded, true, __ATOMIC_RELEASE);
+		return;
+	}
+
+	if (fdt_node->classes & class_bit) {
+		dt_expand_children(node);
+		dt_for_each_child(node, child) {
+			__dt_expand_class(child, class_bit);
+			subtree &= dt_subtree_expanded(child);
+		}
+
+		/* Everything below node may have been created by now */
+		if (subtree)
+			__atomic_store_n(&node->subtree_expanded, true, __ATOMIC_RELEASE);
+	}
+
+	__atomic_or_fetch(&node->expanded_classes, class_bit, __ATOMIC_RELEASE);
+}
+
+/*
+ * Creates the nodes below node which lead to targets of the given class,
+ * leaving subtrees without any of them alone. Each node records the classes
+ * that have been created below it so later calls return straight away.
+ */
+void dt_expand_class(struct pdbg_target *node, const char *klass)
+{
+	__dt_expand_class(node, target_class_bit(klass));
+}
+
+bool pdbg_target_contains_class(struct pdbg_target *target, const char *klass)
+{
+	uint64_t class_bit = target_class_bit(klass);
+
+	if (!(dt_fdt_node(target)->classes & class_bit))
+		return false;
+
+	/* Builtin classes have a bit of their own but others share one */
+	if (class_bit != 1ULL << CLASS_NONE)
+		return true;
+
+	return dt_fdt_contains_class(target->fdt_offset, klass);
 }
 
 static u64 dt_get_number(const void *pdata, unsigned int cells)
@@ -631,14 +969,41 @@ uint64_t pdbg_target_address(struct pdbg_target *target, uint64_t *out_size)
 	n = (na + ns) * sizeof(u32);
 	assert(n <= p->len);
 	if (out_size)
-		*out_size = dt_get_number(p->prop + na * sizeof(u32), ns);
+		*out_size = dt_get_number((const char *)p->prop + na * sizeof(u32), ns);
 	return dt_get_number(p->prop, na);
 }
 
+void pdbg_set_lazy_expand(bool enable)
+{
+	dt_lazy = enable;
+}
+
 void pdbg_targets_init(void *fdt)
 {
+	int err;
+
+	PR_DEBUG("FDT: Parsing fdt @%p\n", fdt);
+
+	err = fdt_check_header(fdt);
+	if (err) {
+		prerror("FDT: Error %d parsing header\n", err);
+		abort();
+	}
+
 	pdbg_dt_root = dt_new_node("", NULL, 0);
-	dt_expand(fdt);
+	pdbg_dt_fdt = fdt;
+	free(dt_fdt_nodes);
+	dt_fdt_nodes = NULL;
+	dt_expand_properties(pdbg_dt_root);
+	target_class_index_invalidate();
+	if (!dt_lazy)
+		dt_expand_subtree(pdbg_dt_root);
+	target_class_index_update();
+}
+
+const void *pdbg_targets_fdt(void)
+{
+	return pdbg_dt_fdt;
 }
 
 char *pdbg_target_path(const struct pdbg_target *target)
@@ -0,0 +1,180 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hash.h"
+
+#define HASH_INITIAL_SIZE	64
+
+/* FNV-1a */
+uint32_t hash_string(const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (uint8_t) *str++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+uint32_t hash_pointer(const void *ptr, uint32_t hash)
+{
+	uintptr_t val = (uintptr_t) ptr;
+	int i;
+
+	for (i = 0; i < sizeof(val); i++) {
+		hash ^= val & 0xff;
+		hash *= 16777619U;
+		val >>= 8;
+	}
+
+	return hash;
+}
+
+bool hash_string_equal(const void *a, const void *b)
+{
+	return !strcmp(a, b);
+}
+
+static void hash_resize(struct hash_table *table, uint32_t size)
+{
+	struct hash_entry **buckets, *entry, *next;
+	uint32_t i;
+
+	buckets = calloc(size, sizeof(*buckets));
+	assert(buckets);
+
+	for (i = 0; i < table->size; i++) {
+		for (entry = table->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (size - 1)];
+			buckets[entry->hash & (size - 1)] = entry;
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->size = size;
+}
+
+static struct hash_entry *hash_lookup(struct hash_table *table, uint32_t hash, const void *key)
+{
+	struct hash_entry *entry;
+
+	if (!table->size)
+		return NULL;
+
+	for (entry = table->buckets[hash & (table->size - 1)]; entry; entry = entry->next)
+		if (entry->hash == hash && table->equal(entry->key, key))
+			return entry;
+
+	return NULL;
+}
+
+void *hash_find(struct hash_table *table, uint32_t hash, const void *key)
+{
+	struct hash_entry *entry = hash_lookup(table, hash, key);
+
+	return entry ? entry->value : NULL;
+}
+
+void hash_insert(struct hash_table *table, uint32_t hash, const void *key, void *value)
+{
+	struct hash_entry *entry;
+
+	entry = hash_lookup(table, hash, key);
+	if (entry) {
+		entry->key = key;
+		entry->value = value;
+		return;
+	}
+
+	/* Keep the table at most fully loaded */
+	if (table->count >= table->size)
+		hash_resize(table, table->size ? table->size * 2 : HASH_INITIAL_SIZE);
+
+	entry = malloc(sizeof(*entry));
+	assert(entry);
+	entry->hash = hash;
+	entry->key = key;
+	entry->value = value;
+	entry->next = table->buckets[hash & (table->size - 1)];
+	table->buckets[hash & (table->size - 1)] = entry;
+	table->count++;
+}
+
+void *hash_remove(struct hash_table *table, uint32_t hash, const void *key)
+{
+	struct hash_entry **link, *entry;
+	void *value;
+
+	if (!table->size)
+		return NULL;
+
+	for (link = &table->buckets[hash & (table->size - 1)]; *link; link = &(*link)->next) {
+		entry = *link;
+		if (entry->hash == hash && table->equal(entry->key, key)) {
+			*link = entry->next;
+			value = entry->value;
+			free(entry);
+			table->count--;
+			return value;
+		}
+	}
+
+	return NULL;
+}
+
+static struct hash_table strings = HASH_TABLE_INIT(hash_string_equal);
+
+const char *str_intern(const char *str)
+{
+	uint32_t hash = hash_string(str);
+	char *copy;
+
+	copy = hash_find(&strings, hash, str);
+	if (copy)
+		return copy;
+
+	copy = strdup(str);
+	assert(copy);
+	hash_insert(&strings, hash, copy, copy);
+
+	return copy;
+}
+
+const char *str_intern_static(const char *str)
+{
+	uint32_t hash = hash_string(str);
+	const char *shared;
+
+	shared = hash_find(&strings, hash, str);
+	if (shared)
+		return shared;
+
+	hash_insert(&strings, hash, str, (void *) str);
+
+	return str;
+}
+
+const char *str_interned(const char *str)
+{
+	return hash_find(&strings, hash_string(str), str);
+}
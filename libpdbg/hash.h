@@ -0,0 +1,70 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LIBPDBG_HASH_H
+#define __LIBPDBG_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A simple chained hash table. The caller supplies the hash of each key and
+ * a function to compare keys so the same table works for strings as well as
+ * compound keys.
+ */
+struct hash_entry {
+	struct hash_entry *next;
+	uint32_t hash;
+	const void *key;
+	void *value;
+};
+
+struct hash_table {
+	struct hash_entry **buckets;
+	uint32_t size;
+	uint32_t count;
+	bool (*equal)(const void *a, const void *b);
+};
+
+#define HASH_TABLE_INIT(eq) { .equal = eq }
+
+uint32_t hash_string(const char *str);
+uint32_t hash_pointer(const void *ptr, uint32_t hash);
+bool hash_string_equal(const void *a, const void *b);
+
+/* Returns the value for key or NULL if it isn't in the table */
+void *hash_find(struct hash_table *table, uint32_t hash, const void *key);
+
+/* Adds key to the table, replacing both the key and the value if an equal
+ * key is already present. The key already in the table is compared against
+ * so it must still be valid. */
+void hash_insert(struct hash_table *table, uint32_t hash, const void *key, void *value);
+
+/* Removes key from the table returning its value or NULL if it wasn't
+ * present. Keys must be removed before the memory they point to is freed or
+ * moved. */
+void *hash_remove(struct hash_table *table, uint32_t hash, const void *key);
+
+/* Returns the single shared copy of str, copying it the first time */
+const char *str_intern(const char *str);
+
+/* As above but str itself becomes the shared copy if there isn't one yet so
+ * it must never be freed */
+const char *str_intern_static(const char *str);
+
+/* Returns the shared copy of str or NULL if str has never been interned */
+const char *str_interned(const char *str);
+
+#endif
@@ -58,8 +58,7 @@ static int xscom_read(struct pib *pib, uint64_t addr, uint64_t *val)
 	int fd = *(int *) pib->priv;
 
 	addr = xscom_mangle_addr(addr);
-	lseek64(fd, addr, SEEK_SET);
-	rc = read(fd, val, 8);
+	rc = pread(fd, val, 8, addr);
 	if (rc != 8)
 		return -1;
 
@@ -72,8 +71,7 @@ static int xscom_write(struct pib *pib, uint64_t addr, uint64_t val)
 	int fd = *(int *) pib->priv;
 
 	addr = xscom_mangle_addr(addr);
-	lseek64(fd, addr, SEEK_SET);
-	rc = write(fd, &val, 8);
+	rc = pwrite(fd, &val, 8, addr);
 	if (rc != 8)
 		return -1;
 
@@ -29,6 +29,7 @@
 #include "bitutils.h"
 #include "target.h"
 #include "debug.h"
+#include "stats.h"
 
 #define HTM_ERR(x) ({int rc = (x); if (rc) {PR_ERROR("HTM Error %d %s:%d\n", \
 			rc, __FILE__, __LINE__);} \
@@ -847,16 +848,21 @@ static bool htm_complete(struct htm_status *status)
 static int htm_wait_complete(struct htm *htm)
 {
 	struct htm_status status;
+	uint64_t start = stats_start();
+	int rc = 0;
 
 	while (1) {
-		if (HTM_ERR(get_status(htm, &status)))
-			return -1;
+		if (HTM_ERR(get_status(htm, &status))) {
+			rc = -1;
+			break;
+		}
 		PR_DEBUG("loop curr:0x%016" PRIx64 "\n", status.mem_last);
 		if (htm_complete(&status))
 			break;
 		usleep(100000);
 	}
-	return 0;
+	stats_record(&htm->target, PDBG_STAT_POLL, start, rc);
+	return rc;
 }
 
 static int do_htm_status(struct htm *htm)
@@ -25,6 +25,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <endian.h>
+#include <pthread.h>
 
 #include "bitutils.h"
 #include "operations.h"
@@ -33,20 +34,17 @@
 #define FSI_SCAN_PATH "/sys/bus/platform/devices/gpio-fsi/fsi0/rescan"
 #define FSI_CFAM_PATH "/sys/devices/platform/gpio-fsi/fsi0/slave@00:00/raw"
 
-int fsi_fd;
+static int fsi_fd;
+static pthread_mutex_t fsi_fd_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int kernel_fsi_getcfam(struct fsi *fsi, uint32_t addr64, uint32_t *value)
 {
 	int rc;
 	uint32_t tmp, addr = (addr64 & 0x7ffc00) | ((addr64 & 0x3ff) << 2);
 
-	rc = lseek(fsi_fd, addr, SEEK_SET);
-	if (rc < 0) {
-		warn("Failed to seek %s", FSI_CFAM_PATH);
-		return errno;
-	}
-
-	rc = read(fsi_fd, &tmp, 4);
+	/* Use positional IO so concurrent accesses can't race on the file
+	 * offset */
+	rc = pread(fsi_fd, &tmp, 4, addr);
 	if (rc < 0) {
 		if ((addr64 & 0xfff) != 0xc09)
 			/* We expect reads of 0xc09 to occasionally
@@ -65,14 +63,8 @@ static int kernel_fsi_putcfam(struct fsi *fsi, uint32_t addr64, uint32_t data)
 	int rc;
 	uint32_t tmp, addr = (addr64 & 0x7ffc00) | ((addr64 & 0x3ff) << 2);
 
-	rc = lseek(fsi_fd, addr, SEEK_SET);
-	if (rc < 0) {
-		warn("Failed to seek %s", FSI_CFAM_PATH);
-		return errno;
-	}
-
 	tmp = htobe32(data);
-	rc = write(fsi_fd, &tmp, 4);
+	rc = pwrite(fsi_fd, &tmp, 4, addr);
 	if (rc < 0) {
 		warn("Failed to write to 0x%08" PRIx32 " (%016" PRIx32 ")", addr, addr64);
 		return errno;
@@ -109,14 +101,20 @@ static void kernel_fsi_scan_devices(void)
 
 int kernel_fsi_probe(struct pdbg_target *target)
 {
+	int rc = -1;
+
+	/* Only the first target to be probed opens the device */
+	pthread_mutex_lock(&fsi_fd_lock);
 	if (!fsi_fd) {
 		int tries = 5;
 
 		while (tries) {
 			/* Open first raw device */
 			fsi_fd = open(FSI_CFAM_PATH, O_RDWR | O_SYNC);
-			if (fsi_fd >= 0)
-				return 0;
+			if (fsi_fd >= 0) {
+				rc = 0;
+				goto out;
+			}
 			tries--;
 
 			/* Scan */
@@ -125,12 +123,14 @@ int kernel_fsi_probe(struct pdbg_target *target)
 		}
 		if (fsi_fd < 0) {
 			err(errno, "Unable to open %s", FSI_CFAM_PATH);
-			return -1;
+			goto out;
 		}
 
 	}
 
-	return -1;
+out:
+	pthread_mutex_unlock(&fsi_fd_lock);
+	return rc;
 }
 
 static struct fsi kernel_fsi = {
@@ -1,50 +1,85 @@
 #include <string.h>
+#include <pthread.h>
 
 #include "target.h"
 #include "libpdbg.h"
 
 static pdbg_progress_tick_t progress_tick;
+static pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the position in the class index of the first target at or after
+ * tree position pos */
+static uint32_t class_index_search(struct pdbg_target_class *target_class, uint32_t pos)
+{
+	uint32_t lo = 0, hi = target_class->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (target_class->index[mid]->tree_pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
 
 struct pdbg_target *__pdbg_next_target(const char *class, struct pdbg_target *parent, struct pdbg_target *last)
 {
-	struct pdbg_target *next, *tmp;
+	struct pdbg_target *next = NULL, *root;
 	struct pdbg_target_class *target_class;
+	uint32_t pos;
 
-	if (class && !find_target_class(class))
-		return NULL;
+	/* Every target the walk could return needs to exist before the index
+	 * is searched, but subtrees without any targets of the class don't */
+	root = parent ? parent : pdbg_target_root();
+	if (!last && root)
+		dt_expand_class(root, class);
 
-	target_class = require_target_class(class);
+	/* Other threads may be adding targets so the index is only valid
+	 * while it's held */
+	target_class_index_lock();
 
-retry:
-	/* No more targets left to check in this class */
-	if ((last && last->class_link.next == &target_class->targets.n) ||
-	    list_empty(&target_class->targets))
-		return NULL;
+	/* Carrying on from the last target saves looking up the class by
+	 * name again */
+	if (last)
+		target_class = target_class_index_get(last->class_id);
+	else
+		target_class = target_class_index_find(class);
+
+	if (!target_class)
+		goto out;
 
 	if (last)
-		next = list_entry(last->class_link.next, struct pdbg_target, class_link);
+		pos = last->class_pos + 1;
+	else if (parent)
+		pos = class_index_search(target_class, parent->tree_pos);
 	else
-		if (!(next = list_top(&target_class->targets, struct pdbg_target, class_link)))
-			return NULL;
+		pos = 0;
 
-	if (!parent)
-		/* Parent is null, no need to check if this is a child */
-		return next;
-	else {
-		/* Check if this target is a child of the given parent */
-		for (tmp = next; tmp && next->parent && tmp != parent; tmp = tmp->parent) {}
-		if (tmp == parent)
-			return next;
-		else {
-			last = next;
-			goto retry;
-		}
-	}
+	/* No more targets left to check in this class */
+	if (pos >= target_class->count)
+		goto out;
+
+	/* The parent and its descendants are contiguous in tree order */
+	next = target_class->index[pos];
+	if (parent && next->tree_pos > parent->tree_end)
+		next = NULL;
+
+out:
+	target_class_index_unlock();
+	return next;
 }
 
 struct pdbg_target *__pdbg_next_child_target(struct pdbg_target *parent, struct pdbg_target *last)
 {
-	if (!parent || list_empty(&parent->children))
+	if (!parent)
+		return NULL;
+
+	if (!last)
+		dt_expand_children(parent);
+
+	if (list_empty(&parent->children))
 		return NULL;
 
 	if (!last)
@@ -58,7 +93,7 @@ struct pdbg_target *__pdbg_next_child_target(struct pdbg_target *parent, struct
 
 enum pdbg_target_status pdbg_target_status(struct pdbg_target *target)
 {
-	return target->status;
+	return __atomic_load_n(&target->status, __ATOMIC_ACQUIRE);
 }
 
 void pdbg_target_status_set(struct pdbg_target *target, enum pdbg_target_status status)
@@ -67,7 +102,7 @@ void pdbg_target_status_set(struct pdbg_target *target, enum pdbg_target_status
 	 * blow up obviously if this happens */
 	assert(status == PDBG_TARGET_DISABLED || status == PDBG_TARGET_MUSTEXIST);
 
-	target->status = status;
+	__atomic_store_n(&target->status, status, __ATOMIC_RELEASE);
 }
 
 /* Searches up the tree and returns the first valid index found */
@@ -87,12 +122,14 @@ uint32_t pdbg_target_index(struct pdbg_target *target)
 struct pdbg_target *pdbg_target_parent(const char *class, struct pdbg_target *target)
 {
 	struct pdbg_target *parent;
+	int class_id;
 
 	if (!class)
 		return target->parent;
 
+	class_id = pdbg_class_id(class);
 	for (parent = target->parent; parent && parent->parent; parent = parent->parent) {
-		if (!strcmp(class, pdbg_target_class_name(parent)))
+		if (parent->class_id == class_id)
 			return parent;
 	}
 
@@ -168,13 +205,20 @@ int pdbg_target_u32_index(struct pdbg_target *target, const char *name, int inde
         return 0;
 }
 
+/* The callback is never called from more than one thread at a time */
 void pdbg_progress_tick(uint64_t cur, uint64_t end)
 {
-	if (progress_tick)
-		progress_tick(cur, end);
+	pdbg_progress_tick_t fn = __atomic_load_n(&progress_tick, __ATOMIC_ACQUIRE);
+
+	if (!fn)
+		return;
+
+	pthread_mutex_lock(&progress_lock);
+	fn(cur, end);
+	pthread_mutex_unlock(&progress_lock);
 }
 
 void pdbg_set_progress_tick(pdbg_progress_tick_t fn)
 {
-	progress_tick = fn;
+	__atomic_store_n(&progress_tick, fn, __ATOMIC_RELEASE);
 }
@@ -95,9 +95,34 @@ uint64_t pdbg_target_address(struct pdbg_target *target, uint64_t *size);
 	(index == 0 ? pdbg_target_address(target, size) : assert(0))
 
 /* Misc. */
+/* Names and property values are used directly from fdt so it must remain
+ * valid for as long as the targets are used */
 void pdbg_targets_init(void *fdt);
+
+/* Only create targets from the device tree when they are first reached by
+ * iterating over targets or looking them up by path rather than all at once
+ * in pdbg_targets_init(), which must be called after this. Targets may be
+ * iterated, looked up and created this way from several threads at once. */
+void pdbg_set_lazy_expand(bool enable);
+
+/* Returns true if any target below the given one is of the given class. This
+ * doesn't create any targets which haven't been created yet. */
+bool pdbg_target_contains_class(struct pdbg_target *target, const char *klass);
 void pdbg_target_probe_all(struct pdbg_target *parent);
 enum pdbg_target_status pdbg_target_probe(struct pdbg_target *target);
+void pdbg_target_probe_list(struct pdbg_target *targets[], int count);
+
+/* Probe targets behind different FSI links or PIBs in parallel threads in
+ * pdbg_target_probe_all() and pdbg_target_probe_list(). Off by default. */
+void pdbg_set_parallel_probe(bool enable);
+
+/* Optionally cache probe results in a file between runs. The cache is only
+ * used if it was saved with the same key and device tree. Must be called
+ * after pdbg_targets_init() and before any targets are probed. Returns 0 if
+ * a usable cache was loaded. pdbg_probe_cache_save() writes the results of
+ * probing back to the file. */
+int pdbg_probe_cache_load(const char *path, const char *key);
+int pdbg_probe_cache_save(void);
 void pdbg_target_release(struct pdbg_target *target);
 enum pdbg_target_status pdbg_target_status(struct pdbg_target *target);
 void pdbg_target_status_set(struct pdbg_target *target, enum pdbg_target_status status);
@@ -106,6 +131,12 @@ char *pdbg_target_path(const struct pdbg_target *target);
 struct pdbg_target *pdbg_target_from_path(struct pdbg_target *target, const char *path);
 uint32_t pdbg_parent_index(struct pdbg_target *target, char *klass);
 char *pdbg_target_class_name(struct pdbg_target *target);
+
+/* Classes are also identified by a small integer which is quicker to compare
+ * than the name. IDs are only meaningful within a single process.
+ * pdbg_class_id() returns -1 for a class which doesn't exist. */
+int pdbg_target_class_id(struct pdbg_target *target);
+int pdbg_class_id(const char *klass);
 char *pdbg_target_name(struct pdbg_target *target);
 const char *pdbg_target_dn_name(struct pdbg_target *target);
 void *pdbg_target_priv(struct pdbg_target *target);
@@ -117,7 +148,12 @@ bool pdbg_target_compatible(struct pdbg_target *target, const char *compatible);
  * space of a "base" target.  */
 struct pdbg_target *pdbg_address_absolute(struct pdbg_target *target, uint64_t *addr);
 
-/* Procedures */
+/* Procedures
+ *
+ * Accesses through FSI, PIB and ADU targets may be made from several threads
+ * at once. Each access holds a lock on the FSI, PIB or ADU it goes through so
+ * accesses to different chips run in parallel. Sequences of accesses which
+ * must not be interleaved need to be serialised by the caller. */
 int fsi_read(struct pdbg_target *target, uint32_t addr, uint32_t *val);
 int fsi_write(struct pdbg_target *target, uint32_t addr, uint32_t val);
 
@@ -179,8 +215,61 @@ int ram_start_thread(struct pdbg_target *target);
 int ram_step_thread(struct pdbg_target *target, int steps);
 int ram_stop_thread(struct pdbg_target *target);
 int ram_sreset_thread(struct pdbg_target *target);
+
+/* Start, stop or step all the threads on a core whose thread index bit is set
+ * in thread_mask. Where the hardware allows this is done with a single write
+ * for the whole core. ram_step_core() clears the bits of threads which
+ * couldn't be stepped so that only those which were are left set. */
+int ram_start_core(struct pdbg_target *core, uint64_t thread_mask);
+int ram_stop_core(struct pdbg_target *core, uint64_t thread_mask);
+int ram_step_core(struct pdbg_target *core, uint64_t *thread_mask, int steps);
+
+/* Stop the threads in thread_masks[i] on cores[i] for every core with the
+ * stops for all cores issued back to back before waiting for any of them to
+ * quiesce. Optionally returns the time between the first and last stop. */
+int ram_stop_cores(struct pdbg_target *cores[], uint64_t thread_masks[],
+		   int count, uint64_t *skew_ns);
+
+/* Probe a set of cores and wake up any which aren't already awake, asserting
+ * special wakeup on all of them before waiting for any with cores on
+ * different chips woken up in parallel. Cores are otherwise woken up one at
+ * a time when first accessed. */
+void core_special_wakeup(struct pdbg_target *cores[], int count);
+
+/* Conditions for ram_step_until(). Stepping stops as soon as any condition
+ * is met:
+ *  - the NIA matches one of the naddrs addresses in addrs
+ *  - the NIA leaves [range_start, range_end) if range_end is non-zero
+ *  - max_steps steps have been done if max_steps is non-zero */
+struct thread_step_until {
+	const uint64_t *addrs;
+	int naddrs;
+	uint64_t range_start;
+	uint64_t range_end;
+	uint64_t max_steps;
+};
+
+/* Single step a quiesced thread until one of the conditions is met. Returns
+ * the final NIA and number of steps taken. */
+int ram_step_until(struct pdbg_target *thread, const struct thread_step_until *until,
+		   uint64_t *nia, uint64_t *steps);
+
+/* Called by ram_step_trace() with the NIA and optionally the GPRs before the
+ * first step and after each step. Return non-zero to stop tracing. */
+typedef int (*pdbg_step_trace_fn)(struct pdbg_target *thread, uint64_t nia,
+				  const uint64_t *gprs, void *priv);
+
+/* Single step a quiesced thread count times calling fn at each step. */
+int ram_step_trace(struct pdbg_target *thread, uint64_t count, bool gprs,
+		   pdbg_step_trace_fn fn, void *priv);
 int ram_state_thread(struct pdbg_target *target, struct thread_regs *regs);
+int ram_getregs(struct pdbg_target *target, struct thread_regs *regs);
+void ram_print_regs(const struct thread_regs *regs);
 struct thread_state thread_status(struct pdbg_target *target);
+
+/* thread_status() returns the status read when the core was last woken up,
+ * started or stopped. Re-reads it for every thread on the core. */
+int thread_status_refresh(struct pdbg_target *core);
 int ram_getxer(struct pdbg_target *thread, uint64_t *value);
 int ram_putxer(struct pdbg_target *thread, uint64_t value);
 int getring(struct pdbg_target *chiplet_target, uint64_t ring_addr, uint64_t ring_len, uint32_t result[]);
@@ -224,6 +313,120 @@ int __adu_putmem(struct pdbg_target *target, uint64_t addr, uint8_t *input,
 int opb_read(struct pdbg_target *target, uint32_t addr, uint32_t *data);
 int opb_write(struct pdbg_target *target, uint32_t addr, uint32_t data);
 
+/*
+ * Asynchronous FSI, PIB and ADU accesses. Operations submitted to a queue
+ * are run by a thread per bus (the FSI link, or PIB if there isn't one) so
+ * that accesses to different chips overlap. Operations on the same bus run
+ * in the order they were submitted. The operations belong to the caller and
+ * must not be changed or freed until they have been reaped. Targets must
+ * have been probed.
+ */
+enum pdbg_async_type {
+	PDBG_ASYNC_FSI_READ,
+	PDBG_ASYNC_FSI_WRITE,
+	PDBG_ASYNC_PIB_READ,
+	PDBG_ASYNC_PIB_WRITE,
+	PDBG_ASYNC_ADU_GETMEM,
+	PDBG_ASYNC_ADU_PUTMEM,
+};
+
+struct pdbg_async_op {
+	enum pdbg_async_type type;
+	struct pdbg_target *target;
+	uint64_t addr;
+	uint64_t data;		/* Value to write or the value read */
+	uint8_t *buf;		/* ADU buffer of size bytes */
+	uint64_t size;
+	bool ci;		/* Cache-inhibited ADU access */
+	int rc;			/* Result once completed */
+	void *priv;		/* For the caller */
+
+	/* Used by libpdbg while the operation is in flight */
+	struct pdbg_async_op *next;
+};
+
+struct pdbg_async;
+
+struct pdbg_async *pdbg_async_create(void);
+
+/* Waits for every submitted operation to complete first */
+void pdbg_async_destroy(struct pdbg_async *queue);
+
+int pdbg_async_submit(struct pdbg_async *queue, struct pdbg_async_op *op);
+
+/* Returns a completed operation or NULL if there aren't any. If wait is set
+ * this waits for an operation to complete unless none are outstanding. */
+struct pdbg_async_op *pdbg_async_reap(struct pdbg_async *queue, bool wait);
+
+/* Number of operations submitted which haven't been reaped */
+int pdbg_async_outstanding(struct pdbg_async *queue);
+
+/* File descriptor which is readable while there are completed operations to
+ * reap. It must only be polled, not read. */
+int pdbg_async_fd(struct pdbg_async *queue);
+
+/*
+ * Operation statistics. Once enabled every FSI, PIB, OPB and ADU access is
+ * counted and timed against the target it went through, instructions rammed
+ * against their thread, time spent polling for hardware to finish against
+ * the target being polled, probes against the target probed and waits for
+ * another thread to finish with an FSI, PIB or ADU against that target.
+ * Latencies are kept in a histogram where
+ * bucket n counts operations which took at least pdbg_stat_bucket_ns(n) but
+ * less than pdbg_stat_bucket_ns(n + 1) nanoseconds. The last bucket counts
+ * everything longer.
+ */
+enum pdbg_stat_op {
+	PDBG_STAT_FSI_READ,
+	PDBG_STAT_FSI_WRITE,
+	PDBG_STAT_PIB_READ,
+	PDBG_STAT_PIB_WRITE,
+	PDBG_STAT_OPB_READ,
+	PDBG_STAT_OPB_WRITE,
+	PDBG_STAT_ADU_GETMEM,
+	PDBG_STAT_ADU_PUTMEM,
+	PDBG_STAT_RAM,
+	PDBG_STAT_POLL,
+	PDBG_STAT_PROBE,
+	PDBG_STAT_LOCK,
+	PDBG_STAT_OP_COUNT,
+};
+
+#define PDBG_STAT_BUCKETS	32
+
+struct pdbg_stat {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[PDBG_STAT_BUCKETS];
+};
+
+void pdbg_stats_enable(bool enable);
+const char *pdbg_stat_name(enum pdbg_stat_op op);
+uint64_t pdbg_stat_bucket_ns(int bucket);
+
+/* Copies the statistics for target, or the totals over every target if
+ * target is NULL, and resets them to zero if reset is set */
+void pdbg_stats_get(struct pdbg_target *target,
+		    struct pdbg_stat stats[PDBG_STAT_OP_COUNT], bool reset);
+
+/* Returns the first target with statistics after prev, or the first of all
+ * if prev is NULL, in the order operations were first recorded on them */
+struct pdbg_target *pdbg_stats_next_target(struct pdbg_target *prev);
+
+/*
+ * Timeline tracing. Once enabled each operation counted by the statistics
+ * above is also recorded with its start and end times, thread and target.
+ * Each thread records into its own ring buffer which keeps the most recent
+ * events.
+ */
+void pdbg_trace_enable(bool enable);
+
+/* Writes the recorded events to path in the Chrome trace event format.
+ * Should only be called once no other threads are recording events. */
+int pdbg_trace_write(const char *path);
+
 typedef void (*pdbg_progress_tick_t)(uint64_t cur, uint64_t end);
 
 void pdbg_set_progress_tick(pdbg_progress_tick_t fn);
@@ -25,6 +25,7 @@
 #include "operations.h"
 #include "bitutils.h"
 #include "debug.h"
+#include "stats.h"
 
 #define RAS_STATUS_TIMEOUT	100
 
@@ -142,25 +143,30 @@ static uint64_t mtxerf(uint64_t reg, uint64_t field)
 
 static int assert_special_wakeup(struct core *chip)
 {
-	int i = 0;
-	uint64_t gp0;
+	int i = 0, rc;
+	uint64_t gp0, start;
 
 	/* Assert special wakeup to prevent low power states */
 	CHECK_ERR(pib_write(&chip->target, PMSPCWKUPFSP_REG, FSP_SPECIAL_WAKEUP));
 
 	/* Poll for completion */
+	start = stats_start();
 	do {
 		usleep(1);
-		CHECK_ERR(pib_read(&chip->target, EX_PM_GP0_REG, &gp0));
+		rc = pib_read(&chip->target, EX_PM_GP0_REG, &gp0);
+		if (rc)
+			break;
 
 		if (i++ > SPECIAL_WKUP_TIMEOUT) {
 			PR_ERROR("Timeout waiting for special wakeup on %s@0x%08" PRIx64 "\n", chip->target.name,
 				 pdbg_target_address(&chip->target, NULL));
-			return -1;
+			rc = -1;
+			break;
 		}
 	} while (!(gp0 & SPECIAL_WKUP_DONE));
+	stats_record(&chip->target, PDBG_STAT_POLL, start, rc);
 
-	return 0;
+	return rc;
 }
 
 #if 0
@@ -174,25 +180,14 @@ static int deassert_special_wakeup(struct core *chip)
 }
 #endif
 
-static struct thread_state get_thread_status(struct thread *thread)
+static struct thread_state decode_thread_status(uint64_t ras_status, uint64_t pow_status)
 {
-	uint64_t val, mode_reg;
 	struct thread_state thread_status;
 
-	/* Need to activete debug mode to get complete status */
-	pib_read(&thread->target, RAS_MODE_REG, &mode_reg);
-	pib_write(&thread->target, RAS_MODE_REG, mode_reg | MR_THREAD_IN_DEBUG);
-
-	/* Read status */
-	pib_read(&thread->target, RAS_STATUS_REG, &val);
-
-	thread_status.active = !!(val & RAS_STATUS_THREAD_ACTIVE);
-	thread_status.quiesced = !!(val & RAS_STATUS_TS_QUIESCE);
-
-	/* Read POW status */
-	pib_read(&thread->target, POW_STATUS_REG, &val);
+	thread_status.active = !!(ras_status & RAS_STATUS_THREAD_ACTIVE);
+	thread_status.quiesced = !!(ras_status & RAS_STATUS_TS_QUIESCE);
 
-	switch (GETFIELD(PMC_POW_STATE, val)) {
+	switch (GETFIELD(PMC_POW_STATE, pow_status)) {
 	case PMC_POW_STATE_RUN:
 		thread_status.sleep_state = PDBG_THREAD_STATE_RUN;
 		break;
@@ -215,7 +210,7 @@ static struct thread_state get_thread_status(struct thread *thread)
 		assert(0);
 	}
 
-	switch (GETFIELD(PMC_POW_SMT, val)) {
+	switch (GETFIELD(PMC_POW_SMT, pow_status)) {
 	case PMC_POW_SMT_0:
 		thread_status.smt_state = PDBG_SMT_UNKNOWN;
 		break;
@@ -246,39 +241,129 @@ static struct thread_state get_thread_status(struct thread *thread)
 		assert(0);
 	}
 
-	/* Clear debug mode */
-	pib_write(&thread->target, RAS_MODE_REG, mode_reg);
-
 	return thread_status;
 }
 
-static int p8_thread_step(struct thread *thread, int count)
+static int p8_thread_id(struct pdbg_target *target)
 {
-	int i;
-	uint64_t ras_mode, ras_status;
+	return (pdbg_target_address(target, NULL) >> 4) & 0xf;
+}
+
+/*
+ * Read the status of every thread on the core. POWER8 has no core wide
+ * debug mode or status register so each thread still has its RAS mode
+ * read, debug mode set, both status registers read and its mode
+ * restored, the same as reading the threads one at a time. The only
+ * accesses saved are the mode writes for threads already in debug mode.
+ */
+static int p8_core_thread_status(struct core *core)
+{
+	struct pdbg_target *target;
+	struct thread *threads[8];
+	uint64_t mode_reg[8], ras_status, pow_status;
+	int i, count = 0, rc = 0;
+
+	/* Enter debug mode on all threads */
+	pdbg_for_each_compatible(&core->target, target, "ibm,power8-thread") {
+		struct thread *thread = target_to_thread(target);
+
+		assert(count < ARRAY_SIZE(threads));
+		thread->id = p8_thread_id(target);
+
+		if (pib_read(target, RAS_MODE_REG, &mode_reg[count])) {
+			rc = -1;
+			break;
+		}
+
+		threads[count++] = thread;
+		if (mode_reg[count - 1] & MR_THREAD_IN_DEBUG)
+			continue;
+
+		if (pib_write(target, RAS_MODE_REG, mode_reg[count - 1] | MR_THREAD_IN_DEBUG)) {
+			rc = -1;
+			break;
+		}
+	}
+
+	/* Read status */
+	for (i = 0; !rc && i < count; i++) {
+		if (pib_read(&threads[i]->target, RAS_STATUS_REG, &ras_status) ||
+		    pib_read(&threads[i]->target, POW_STATUS_REG, &pow_status)) {
+			rc = -1;
+			break;
+		}
+
+		threads[i]->status = decode_thread_status(ras_status, pow_status);
+	}
+
+	/* Clear debug mode on the threads we put into it */
+	for (i = 0; i < count; i++) {
+		if (mode_reg[i] & MR_THREAD_IN_DEBUG)
+			continue;
+
+		if (pib_write(&threads[i]->target, RAS_MODE_REG, mode_reg[i]))
+			rc = -1;
+	}
+
+	return rc;
+}
+
+static int p8_thread_step_setup(struct thread *thread)
+{
+	uint64_t ras_mode;
 
 	/* Activate single-step mode */
 	CHECK_ERR(pib_read(&thread->target, RAS_MODE_REG, &ras_mode));
 	ras_mode |= MR_DO_SINGLE_MODE;
 	CHECK_ERR(pib_write(&thread->target, RAS_MODE_REG, ras_mode));
 
-	/* Step the core */
-	for (i = 0; i < count; i++) {
-		CHECK_ERR(pib_write(&thread->target, DIRECT_CONTROLS_REG, DIRECT_CONTROL_SP_STEP));
+	return 0;
+}
 
-		/* Wait for step to complete */
-		do {
-			CHECK_ERR(pib_read(&thread->target, RAS_STATUS_REG, &ras_status));
-		} while (!(ras_status & RAS_STATUS_INST_COMPLETE));
-	}
+static int p8_thread_step_once(struct thread *thread)
+{
+	uint64_t ras_status, start;
+	int rc;
+
+	CHECK_ERR(pib_write(&thread->target, DIRECT_CONTROLS_REG, DIRECT_CONTROL_SP_STEP));
+
+	/* Wait for step to complete */
+	start = stats_start();
+	do {
+		rc = pib_read(&thread->target, RAS_STATUS_REG, &ras_status);
+	} while (!rc && !(ras_status & RAS_STATUS_INST_COMPLETE));
+	stats_record(&thread->target, PDBG_STAT_POLL, start, rc);
+
+	return rc;
+}
+
+static int p8_thread_step_destroy(struct thread *thread)
+{
+	uint64_t ras_mode;
 
 	/* Deactivate single-step mode */
+	CHECK_ERR(pib_read(&thread->target, RAS_MODE_REG, &ras_mode));
 	ras_mode &= ~MR_DO_SINGLE_MODE;
 	CHECK_ERR(pib_write(&thread->target, RAS_MODE_REG, ras_mode));
 
 	return 0;
 }
 
+static int p8_thread_step(struct thread *thread, int count)
+{
+	int i;
+
+	CHECK_ERR(p8_thread_step_setup(thread));
+
+	/* Step the core */
+	for (i = 0; i < count; i++)
+		CHECK_ERR(p8_thread_step_once(thread));
+
+	CHECK_ERR(p8_thread_step_destroy(thread));
+
+	return 0;
+}
+
 static int p8_thread_stop(struct thread *thread)
 {
 	int i = 0;
@@ -354,17 +439,21 @@ static int p8_ram_setup(struct thread *thread)
 		return 1;
 
 	/* We can only ram a thread if all the threads on the core/chip are
-	 * quiesced */
+	 * quiesced. If a thread wasn't enabled it may not yet have been
+	 * probed so do that now. */
 	pdbg_for_each_compatible(&chip->target, target, "ibm,power8-thread") {
-		struct thread *tmp;
-
-		/* If this thread wasn't enabled it may not yet have been probed
-		   so do that now. This will also update the thread status */
 		if (pdbg_target_probe(target) != PDBG_TARGET_ENABLED)
 			return 1;
+	}
+
+	/* Refresh the status of every thread on the core */
+	if (p8_core_thread_status(chip))
+		return 1;
 
-		tmp = target_to_thread(target);
-		if (!(get_thread_status(tmp).quiesced))
+	pdbg_for_each_compatible(&chip->target, target, "ibm,power8-thread") {
+		struct thread *tmp = target_to_thread(target);
+
+		if (!(tmp->status.quiesced))
 			return 1;
 	}
 
@@ -392,7 +481,8 @@ static int p8_ram_instruction(struct thread *thread, uint64_t opcode, uint64_t *
 {
 	struct core *chip = target_to_core(
 		pdbg_target_require_parent("core", &thread->target));
-	uint64_t val;
+	uint64_t val, start;
+	int rc;
 
 	if (!thread->ram_is_setup)
 		return 1;
@@ -405,9 +495,12 @@ static int p8_ram_instruction(struct thread *thread, uint64_t opcode, uint64_t *
 	CHECK_ERR(pib_write(&chip->target, RAM_CTRL_REG, val));
 
 	/* wait for completion */
+	start = stats_start();
 	do {
-		CHECK_ERR(pib_read(&chip->target, RAM_STATUS_REG, &val));
-	} while (!((val & PPC_BIT(1)) || ((val & PPC_BIT(2)) && (val & PPC_BIT(3)))));
+		rc = pib_read(&chip->target, RAM_STATUS_REG, &val);
+	} while (!rc && !((val & PPC_BIT(1)) || ((val & PPC_BIT(2)) && (val & PPC_BIT(3)))));
+	stats_record(&thread->target, PDBG_STAT_POLL, start, rc);
+	CHECK_ERR(rc);
 
 	if (!(val & PPC_BIT(1))) {
 		if (GETFIELD(PPC_BITMASK(2,3), val) == 0x3) {
@@ -479,8 +572,9 @@ static int p8_thread_probe(struct pdbg_target *target)
 {
 	struct thread *thread = target_to_thread(target);
 
-	thread->id = (pdbg_target_address(target, NULL) >> 4) & 0xf;
-	thread->status = get_thread_status(thread);
+	/* The thread status was read along with the rest of the core when
+	 * the parent core was probed */
+	thread->id = p8_thread_id(target);
 
 	return 0;
 }
@@ -535,6 +629,9 @@ static struct thread p8_thread = {
 	},
 	.step = p8_thread_step,
 	.start = p8_thread_start,
+	.step_setup = p8_thread_step_setup,
+	.step_once = p8_thread_step_once,
+	.step_destroy = p8_thread_step_destroy,
 	.stop = p8_thread_stop,
 	.sreset = p8_thread_sreset,
 	.ram_setup = p8_ram_setup,
@@ -546,10 +643,23 @@ static struct thread p8_thread = {
 };
 DECLARE_HW_UNIT(p8_thread);
 
+static int p8_core_wakeup(struct core *core)
+{
+	/* Once tried special wakeup isn't asserted again */
+	core->spwkup_asserted = true;
+	CHECK_ERR(assert_special_wakeup(core));
+
+	/* Snapshot the status of all threads on this core */
+	if (p8_core_thread_status(core))
+		PR_ERROR("Unable to read thread status on %s@0x%08" PRIx64 "\n",
+			 core->target.name, pdbg_target_address(&core->target, NULL));
+
+	return 0;
+}
+
 static int p8_core_probe(struct pdbg_target *target)
 {
 	uint64_t value;
-	struct core *core = target_to_core(target);
 
 	/* Work out if this chip is actually present */
 	if (pib_read(target, SCOM_EX_GP3, &value)) {
@@ -560,7 +670,7 @@ static int p8_core_probe(struct pdbg_target *target)
 	if (!GETFIELD(PPC_BIT(0), value))
 		return -1;
 
-	assert_special_wakeup(core);
+	/* Special wakeup is only asserted once the core is used */
 	return 0;
 }
 
@@ -570,6 +680,9 @@ static struct core p8_core = {
 		.compatible = "ibm,power8-core",
 		.class = "core",
 		.probe = p8_core_probe,
+		.cacheable_probe = true,
 	},
+	.wakeup = p8_core_wakeup,
+	.thread_status = p8_core_thread_status,
 };
 DECLARE_HW_UNIT(p8_core);
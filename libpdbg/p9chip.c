@@ -24,6 +24,7 @@
 #include "operations.h"
 #include "bitutils.h"
 #include "debug.h"
+#include "stats.h"
 
 /*
  * NOTE!
@@ -92,20 +93,16 @@ static uint64_t thread_write(struct thread *thread, uint64_t addr, uint64_t data
 	return pib_write(chip, addr, data);
 }
 
-static struct thread_state p9_get_thread_status(struct thread *thread)
+static struct thread_state p9_decode_thread_status(int id, uint64_t ras_status,
+						    uint64_t thread_info,
+						    uint64_t core_thread_state)
 {
-	uint64_t value;
 	struct thread_state thread_state;
 
-	thread_read(thread, P9_RAS_STATUS, &value);
-
-	thread_state.quiesced = (GETFIELD(PPC_BITMASK(8*thread->id, 3 + 8*thread->id), value) == 0xf);
+	thread_state.quiesced = (GETFIELD(PPC_BITMASK(8*id, 3 + 8*id), ras_status) == 0xf);
+	thread_state.active = !!(thread_info & PPC_BIT(id));
 
-	thread_read(thread, P9_THREAD_INFO, &value);
-	thread_state.active = !!(value & PPC_BIT(thread->id));
-
-	thread_read(thread, P9_CORE_THREAD_STATE, &value);
-	if (value & PPC_BIT(56 + thread->id))
+	if (core_thread_state & PPC_BIT(56 + id))
 		thread_state.sleep_state = PDBG_THREAD_STATE_STOP;
 	else
 		thread_state.sleep_state = PDBG_THREAD_STATE_RUN;
@@ -115,14 +112,57 @@ static struct thread_state p9_get_thread_status(struct thread *thread)
 	return thread_state;
 }
 
+static struct thread_state p9_get_thread_status(struct thread *thread)
+{
+	uint64_t ras_status = 0, thread_info = 0, core_thread_state = 0;
+
+	thread_read(thread, P9_RAS_STATUS, &ras_status);
+	thread_read(thread, P9_THREAD_INFO, &thread_info);
+	thread_read(thread, P9_CORE_THREAD_STATE, &core_thread_state);
+
+	return p9_decode_thread_status(thread->id, ras_status, thread_info,
+				       core_thread_state);
+}
+
+/*
+ * The thread status registers are all core scoped so read them once and
+ * update the status of every thread on the core from the same snapshot
+ * rather than doing three SCOMs per thread.
+ */
+static int p9_core_thread_status(struct core *core)
+{
+	struct pdbg_target *target;
+	uint64_t ras_status, thread_info, core_thread_state;
+
+	CHECK_ERR(pib_read(&core->target, P9_RAS_STATUS, &ras_status));
+	CHECK_ERR(pib_read(&core->target, P9_THREAD_INFO, &thread_info));
+	CHECK_ERR(pib_read(&core->target, P9_CORE_THREAD_STATE, &core_thread_state));
+
+	pdbg_for_each_target("thread", &core->target, target) {
+		struct thread *thread = target_to_thread(target);
+		uint32_t tid;
+
+		if (pdbg_target_u32_property(target, "tid", &tid))
+			continue;
+
+		thread->id = tid;
+		thread->status = p9_decode_thread_status(thread->id, ras_status,
+							 thread_info,
+							 core_thread_state);
+	}
+
+	return 0;
+}
+
 static int p9_thread_probe(struct pdbg_target *target)
 {
 	struct thread *thread = target_to_thread(target);
 	uint32_t tid;
 
+	/* The thread status was read along with the rest of the core when
+	 * the parent core was probed */
 	assert(!pdbg_target_u32_property(target, "tid", &tid));
 	thread->id = tid;
-	thread->status = p9_get_thread_status(thread);
 
 	return 0;
 }
@@ -136,81 +176,267 @@ static void p9_thread_release(struct pdbg_target *target)
 		/* This thread is still quiesced so don't release spwkup */
 		core->release_spwkup = false;}
 
-static int p9_thread_start(struct thread *thread)
+/* Returns true if every thread in thread_mask is quiesced */
+static bool p9_threads_quiesced(uint64_t thread_mask, uint64_t ras_status)
 {
-	if (!(thread->status.quiesced))
-		return 1;
+	int id;
 
-	if ((!(thread->status.active)) ||
-	    (thread->status.sleep_state == PDBG_THREAD_STATE_STOP)) {
-		/* Inactive or active ad stopped: Clear Maint */
-		thread_write(thread, P9_DIRECT_CONTROL, PPC_BIT(3 + 8*thread->id));
-	} else {
-		/* Active and not stopped: Start */
-		thread_write(thread, P9_DIRECT_CONTROL, PPC_BIT(6 + 8*thread->id));
+	for (id = 0; thread_mask; id++, thread_mask >>= 1) {
+		if (!(thread_mask & 1))
+			continue;
+
+		if (GETFIELD(PPC_BITMASK(8*id, 3 + 8*id), ras_status) != 0xf)
+			return false;
 	}
 
-	thread->status = p9_get_thread_status(thread);
+	return true;
+}
+
+static int p9_core_start_threads(struct core *core, uint64_t thread_mask)
+{
+	struct pdbg_target *target;
+	uint64_t value = 0;
+	int rc = 0;
+
+	/* Make sure the thread status is valid */
+	CHECK_ERR(core_wakeup(&core->target));
+
+	pdbg_for_each_target("thread", &core->target, target) {
+		struct thread *thread = target_to_thread(target);
+
+		if (!(thread_mask & (1ULL << thread->id)))
+			continue;
+
+		if (!(thread->status.quiesced)) {
+			rc = 1;
+			continue;
+		}
+
+		if ((!(thread->status.active)) ||
+		    (thread->status.sleep_state == PDBG_THREAD_STATE_STOP)) {
+			/* Inactive or active ad stopped: Clear Maint */
+			value |= PPC_BIT(3 + 8*thread->id);
+		} else {
+			/* Active and not stopped: Start */
+			value |= PPC_BIT(6 + 8*thread->id);
+		}
+	}
+
+	if (!value)
+		return rc;
+
+	CHECK_ERR(pib_write(&core->target, P9_DIRECT_CONTROL, value));
+	CHECK_ERR(p9_core_thread_status(core));
+
+	return rc;
+}
+
+static int p9_core_stop_prepare(struct core *core, uint64_t thread_mask,
+				uint64_t *addr, uint64_t *value)
+{
+	struct pdbg_target *target;
+
+	*addr = P9_DIRECT_CONTROL;
+	*value = 0;
+	pdbg_for_each_target("thread", &core->target, target) {
+		struct thread *thread = target_to_thread(target);
+
+		if (thread_mask & (1ULL << thread->id))
+			*value |= PPC_BIT(7 + 8*thread->id);
+	}
 
 	return 0;
 }
 
-static int p9_thread_stop(struct thread *thread)
+static int p9_core_stop_wait(struct core *core, uint64_t thread_mask)
 {
-	int i = 0;
+	uint64_t value, start;
+	int i = 0, rc;
 
-	thread_write(thread, P9_DIRECT_CONTROL, PPC_BIT(7 + 8*thread->id));
-	while (!(p9_get_thread_status(thread).quiesced)) {
+	/* Wait for all the threads to quiesce */
+	start = stats_start();
+	rc = pib_read(&core->target, P9_RAS_STATUS, &value);
+	while (!rc && !p9_threads_quiesced(thread_mask, value)) {
 		usleep(1000);
 		if (i++ > RAS_STATUS_TIMEOUT) {
-			PR_ERROR("Unable to quiesce thread\n");
+			PR_ERROR("Unable to quiesce threads on %s@0x%08" PRIx64 "\n",
+				 core->target.name,
+				 pdbg_target_address(&core->target, NULL));
 			break;
 		}
+		rc = pib_read(&core->target, P9_RAS_STATUS, &value);
 	}
-	thread->status = p9_get_thread_status(thread);
+	stats_record(&core->target, PDBG_STAT_POLL, start, rc);
+	CHECK_ERR(rc);
+
+	CHECK_ERR(p9_core_thread_status(core));
 
 	return 0;
 }
 
-static int p9_thread_step(struct thread *thread, int count)
+static int p9_core_stop_threads(struct core *core, uint64_t thread_mask)
 {
-	uint64_t value;
-	int i;
+	uint64_t addr, value;
+
+	CHECK_ERR(p9_core_stop_prepare(core, thread_mask, &addr, &value));
+	if (!value)
+		return 0;
+
+	CHECK_ERR(pib_write(&core->target, addr, value));
+
+	return p9_core_stop_wait(core, thread_mask);
+}
 
+/* Returns true if the thread is in a state which allows it to be stepped */
+static bool p9_thread_can_step(struct thread *thread)
+{
 	/* Can only step if a thread is quiesced */
 	if (!(thread->status.quiesced))
-		return 1;
+		return false;
 
 	/* Core must be active to step */
 	if (!(thread->status.active))
-		return 1;
+		return false;
 
 	/* Stepping a stop instruction doesn't really work */
 	if (thread->status.sleep_state == PDBG_THREAD_STATE_STOP)
-		return 1;
+		return false;
+
+	return true;
+}
+
+/* Step the threads with a step bit set in step and wait for all the
+ * matching completion bits in done to be set. Interrupts must already be
+ * fenced. */
+static int p9_core_step_once(struct core *core, uint64_t step, uint64_t done)
+{
+	uint64_t value, start;
+	int rc;
+
+	/* Step */
+	CHECK_ERR(pib_write(&core->target, P9_DIRECT_CONTROL, step));
+
+	/* Poll PPC complete */
+	start = stats_start();
+	do {
+		rc = pib_read(&core->target, P9_RAS_STATUS, &value);
+	} while (!rc && (value & done) != done);
+	stats_record(&core->target, PDBG_STAT_POLL, start, rc);
+
+	return rc;
+}
+
+/* Threads in thread_mask which can't be stepped are reported and removed
+ * from it so that only the threads left in it have been stepped. On an
+ * error none of them are left. */
+static int p9_core_step_threads(struct core *core, uint64_t *thread_mask, int count)
+{
+	struct pdbg_target *target;
+	uint64_t step = 0, done = 0;
+	int i, rc = 0;
+
+	CHECK_ERR(core_wakeup(&core->target));
+
+	pdbg_for_each_target("thread", &core->target, target) {
+		struct thread *thread = target_to_thread(target);
+
+		if (!(*thread_mask & (1ULL << thread->id)))
+			continue;
+
+		if (!p9_thread_can_step(thread)) {
+			PR_ERROR("Unable to step thread %d on %s@0x%08" PRIx64 ", it is not quiesced or is stopped\n",
+				 thread->id, core->target.name,
+				 pdbg_target_address(&core->target, NULL));
+			*thread_mask &= ~(1ULL << thread->id);
+			continue;
+		}
+
+		step |= PPC_BIT(5 + 8*thread->id);
+		done |= PPC_BIT(4 + 8*thread->id);
+	}
+
+	if (!step)
+		return 0;
 
 	/* Fence interrupts. */
-	thread_write(thread, P9_RAS_MODEREG, PPC_BIT(57));
+	CHECK_ERR(pib_write(&core->target, P9_RAS_MODEREG, PPC_BIT(57)));
 
 	/* Step the core */
-	for (i = 0; i < count; i++) {
-		/* Step */
-		thread_write(thread, P9_DIRECT_CONTROL, PPC_BIT(5 + 8*thread->id));
-
-		/* Poll PPC complete */
-		do {
-			thread_read(thread, P9_RAS_STATUS, &value);
-		} while (!(value & PPC_BIT(4 + 8*thread->id)));
-	}
+	for (i = 0; !rc && i < count; i++)
+		rc = p9_core_step_once(core, step, done);
+
+	/* Un-fence, even if stepping failed */
+	if (pib_write(&core->target, P9_RAS_MODEREG, 0))
+		rc = -1;
+
+	/* It isn't known which steps completed */
+	if (rc)
+		*thread_mask = 0;
+
+	return rc;
+}
+
+static int p9_thread_step_setup(struct thread *thread)
+{
+	CHECK_ERR(core_wakeup(thread->target.parent));
+
+	if (!p9_thread_can_step(thread))
+		return 1;
+
+	/* Fence interrupts. */
+	CHECK_ERR(thread_write(thread, P9_RAS_MODEREG, PPC_BIT(57)));
+
+	return 0;
+}
+
+static int p9_thread_step_once(struct thread *thread)
+{
+	struct core *core = target_to_core(
+		pdbg_target_require_parent("core", &thread->target));
+
+	return p9_core_step_once(core, PPC_BIT(5 + 8*thread->id),
+				 PPC_BIT(4 + 8*thread->id));
+}
 
+static int p9_thread_step_destroy(struct thread *thread)
+{
 	/* Un-fence */
-	thread_write(thread, P9_RAS_MODEREG, 0);
+	CHECK_ERR(thread_write(thread, P9_RAS_MODEREG, 0));
 
 	return 0;
 }
 
+static int p9_thread_start(struct thread *thread)
+{
+	struct core *core = target_to_core(
+		pdbg_target_require_parent("core", &thread->target));
+
+	return p9_core_start_threads(core, 1ULL << thread->id);
+}
+
+static int p9_thread_stop(struct thread *thread)
+{
+	struct core *core = target_to_core(
+		pdbg_target_require_parent("core", &thread->target));
+
+	return p9_core_stop_threads(core, 1ULL << thread->id);
+}
+
+static int p9_thread_step(struct thread *thread, int count)
+{
+	struct core *core = target_to_core(
+		pdbg_target_require_parent("core", &thread->target));
+	uint64_t thread_mask = 1ULL << thread->id;
+
+	CHECK_ERR(p9_core_step_threads(core, &thread_mask, count));
+
+	return thread_mask ? 0 : 1;
+}
+
 static int p9_thread_sreset(struct thread *thread)
 {
+	CHECK_ERR(core_wakeup(thread->target.parent));
+
 	/* Can only sreset if a thread is quiesced */
 	if (!(thread->status.quiesced))
 		return 1;
@@ -233,16 +459,21 @@ static int p9_ram_setup(struct thread *thread)
 		return 1;
 
 	/* We can only ram a thread if all the threads on the core/chip are
-	 * quiesced */
+	 * quiesced. If a thread wasn't enabled it may not yet have been
+	 * probed so do that now. */
 	pdbg_for_each_target("thread", &chip->target, target) {
-		struct thread *tmp;
-
-		/* If this thread wasn't enabled it may not yet have been probed
-		   so do that now. This will also update the thread status */
 		if (pdbg_target_probe(target) != PDBG_TARGET_ENABLED)
 			goto out_fail;
+	}
+
+	/* Refresh the status of every thread on the core with a single
+	 * snapshot */
+	if (p9_core_thread_status(chip))
+		goto out_fail;
+
+	pdbg_for_each_target("thread", &chip->target, target) {
+		struct thread *tmp = target_to_thread(target);
 
-		tmp = target_to_thread(target);
 		if (!(tmp->status.quiesced))
 			goto out_fail;
 	}
@@ -435,6 +666,9 @@ static struct thread p9_thread = {
 	.stop = p9_thread_stop,
 	.step = p9_thread_step,
 	.sreset = p9_thread_sreset,
+	.step_setup = p9_thread_step_setup,
+	.step_once = p9_thread_step_once,
+	.step_destroy = p9_thread_step_destroy,
 	.ram_setup = p9_ram_setup,
 	.ram_instruction = p9_ram_instruction,
 	.ram_destroy = p9_ram_destroy,
@@ -510,29 +744,69 @@ static int p9_chiplet_getring(struct chiplet *chiplet, uint64_t ring_addr, int64
 	return 0;
 }
 
-static int p9_core_probe(struct pdbg_target *target)
+static int p9_core_present(struct pdbg_target *target)
 {
-	struct core *core = target_to_core(target);
-	int i = 0;
 	uint64_t value;
 
 	if (pib_read(target, NET_CTRL0, &value))
-		return -1;
+		return 0;
+
+	return !!(value & NET_CTRL0_CHIPLET_ENABLE);
+}
 
-	if (!(value & NET_CTRL0_CHIPLET_ENABLE))
+static int p9_core_spwkup_assert(struct core *core)
+{
+	if (core->spwkup_asserted)
+		return 0;
+
+	if (pib_write(&core->target, PPM_SPWKUP_FSP, PPC_BIT(0)))
 		return -1;
 
-	CHECK_ERR(pib_write(target, PPM_SPWKUP_FSP, PPC_BIT(0)));
-	do {
-		usleep(1000);
-		CHECK_ERR(pib_read(target, PPM_SSHFSP, &value));
+	core->spwkup_asserted = true;
+	return 0;
+}
 
-		if (i++ > SPECIAL_WKUP_TIMEOUT) {
+static int p9_core_spwkup_done(struct core *core)
+{
+	uint64_t value;
+
+	if (core->spwkup_complete)
+		return 1;
+
+	CHECK_ERR(pib_read(&core->target, PPM_SSHFSP, &value));
+	core->spwkup_complete = !!(value & SPECIAL_WKUP_DONE);
+
+	return core->spwkup_complete;
+}
+
+static int p9_core_wakeup(struct core *core)
+{
+	struct pdbg_target *target = &core->target;
+	uint64_t start;
+	int i = 0, rc;
+
+	/* Special wakeup may have already been asserted as part of waking
+	 * up many cores at once */
+	CHECK_ERR(p9_core_spwkup_assert(core));
+
+	start = stats_start();
+	while (!(rc = p9_core_spwkup_done(core))) {
+		if (i++ > core->spwkup_timeout) {
 			PR_ERROR("Timeout waiting for special wakeup on %s@0x%08" PRIx64 "\n", target->name,
 				 pdbg_target_address(target, NULL));
 			break;
 		}
-	} while (!(value & SPECIAL_WKUP_DONE));
+		usleep(1000);
+	}
+	stats_record(target, PDBG_STAT_POLL, start, rc <= 0);
+
+	if (rc < 0)
+		return rc;
+
+	/* Snapshot the status of all threads on this core */
+	if (p9_core_thread_status(core))
+		PR_ERROR("Unable to read thread status on %s@0x%08" PRIx64 "\n",
+			 target->name, pdbg_target_address(target, NULL));
 
 	/* Child threads will set this to false if they are released while quiesced */
 	core->release_spwkup = true;
@@ -540,6 +814,15 @@ static int p9_core_probe(struct pdbg_target *target)
 	return 0;
 }
 
+static int p9_core_probe(struct pdbg_target *target)
+{
+	/* Special wakeup is only asserted once the core is used */
+	if (!p9_core_present(target))
+		return -1;
+
+	return 0;
+}
+
 static void p9_core_release(struct pdbg_target *target)
 {
 	struct pdbg_target *child;
@@ -566,11 +849,17 @@ static void p9_core_release(struct pdbg_target *target)
 		pdbg_target_release(child);
 	}
 
-	if (!core->release_spwkup)
+	if (!core->spwkup_asserted || !core->release_spwkup)
 		return;
 
 	pib_write(target, PPM_SPWKUP_FSP, 0);
-	usleep(10000);
+	core->spwkup_asserted = false;
+	core->spwkup_complete = false;
+	__atomic_store_n(&core->awake, false, __ATOMIC_RELEASE);
+
+	/* Let special wakeup settle. This is waited for once all cores
+	 * have been released rather than after each one. */
+	pdbg_release_delay(10000);
 }
 
 static struct core p9_core = {
@@ -579,8 +868,19 @@ static struct core p9_core = {
 		.compatible = "ibm,power9-core",
 		.class = "core",
 		.probe = p9_core_probe,
+		.cacheable_probe = true,
 		.release = p9_core_release,
 	},
+	.start_threads = p9_core_start_threads,
+	.stop_threads = p9_core_stop_threads,
+	.stop_prepare = p9_core_stop_prepare,
+	.stop_wait = p9_core_stop_wait,
+	.wakeup = p9_core_wakeup,
+	.thread_status = p9_core_thread_status,
+	.spwkup_assert = p9_core_spwkup_assert,
+	.spwkup_done = p9_core_spwkup_done,
+	.spwkup_timeout = SPECIAL_WKUP_TIMEOUT,
+	.step_threads = p9_core_step_threads,
 };
 DECLARE_HW_UNIT(p9_core);
 
@@ -603,6 +903,7 @@ static struct chiplet p9_chiplet = {
                 .compatible = "ibm,power9-chiplet",
                 .class = "chiplet",
                 .probe = p9_chiplet_probe,
+                .cacheable_probe = true,
         },
 	.getring = p9_chiplet_getring,
 };
@@ -0,0 +1,355 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Optional cache of probe results which persists between runs. The cache
+ * file records whether each target was found to exist along with the chip
+ * type behind each FSI. It is only used if it was written for the same key
+ * (which the caller uses to identify the backend) and device tree.
+ *
+ * Before any cached result is used for a target the chip it is on is
+ * validated by comparing the chip type read from the CFAM ID register when
+ * its FSI is probed. A mismatch invalidates the rest of the cache. Targets
+ * which aren't behind an FSI are always probed.
+ *
+ * Entries are looked up by path when a target is probed rather than when the
+ * cache is loaded so that loading it doesn't create targets which haven't
+ * been created yet.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <libfdt/libfdt.h>
+
+#include "target.h"
+#include "operations.h"
+#include "debug.h"
+#include "hash.h"
+
+#define PROBE_CACHE_MAGIC	"pdbg-probe-cache"
+#define PROBE_CACHE_VERSION	1
+
+#define CFAM_CHIP_ID		0xc09
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *cache_path;
+static char *cache_key;
+static bool cache_enabled;
+static bool cache_valid;
+
+struct probe_cache_entry {
+	char *path;
+	enum pdbg_target_status status;
+	enum chip_type chip_type;
+	bool saved;
+};
+
+static struct probe_cache_entry *cache_entries;
+static int cache_count;
+static struct hash_table cache_index = HASH_TABLE_INIT(hash_string_equal);
+
+/* FNV-1a hash of the device tree the targets were created from */
+static uint64_t probe_cache_hash(void)
+{
+	const uint8_t *fdt = pdbg_targets_fdt();
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	if (!fdt)
+		return 0;
+
+	for (i = 0; i < fdt_totalsize(fdt); i++) {
+		hash ^= fdt[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static const char *probe_cache_status_name(enum pdbg_target_status status)
+{
+	switch (status) {
+	case PDBG_TARGET_ENABLED:
+		return "enabled";
+	case PDBG_TARGET_NONEXISTENT:
+		return "nonexistent";
+	default:
+		return NULL;
+	}
+}
+
+static struct pdbg_target *probe_cache_fsi(struct pdbg_target *target)
+{
+	for (target = target->parent; target; target = target->parent)
+		if (target->class_id == CLASS_FSI)
+			return target;
+
+	return NULL;
+}
+
+static struct probe_cache_entry *probe_cache_entry(struct pdbg_target *target)
+{
+	struct probe_cache_entry *entry;
+	char *path;
+
+	path = pdbg_target_path(target);
+	if (!path)
+		return NULL;
+
+	entry = hash_find(&cache_index, hash_string(path), path);
+	free(path);
+
+	return entry;
+}
+
+static void probe_cache_add(char *path, enum pdbg_target_status status,
+			    enum chip_type chip_type)
+{
+	struct probe_cache_entry *entry;
+
+	cache_entries = realloc(cache_entries, (cache_count + 1) * sizeof(*cache_entries));
+	assert(cache_entries);
+
+	entry = &cache_entries[cache_count++];
+	entry->path = path;
+	entry->status = status;
+	entry->chip_type = chip_type;
+	entry->saved = false;
+}
+
+int pdbg_probe_cache_load(const char *path, const char *key)
+{
+	char *file_key = NULL, *target_path, *status;
+	uint64_t hash;
+	int version, chip_type, i, rc = -1;
+	FILE *file;
+
+	/* The cache can only be loaded once */
+	if (cache_enabled)
+		return -1;
+
+	free(cache_path);
+	free(cache_key);
+	cache_path = strdup(path);
+	cache_key = strdup(key);
+	if (!cache_path || !cache_key)
+		return -1;
+
+	cache_enabled = true;
+	cache_valid = false;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -1;
+
+	if (fscanf(file, PROBE_CACHE_MAGIC " %d %ms %" SCNx64,
+		   &version, &file_key, &hash) != 3)
+		goto out;
+
+	if (version != PROBE_CACHE_VERSION || strcmp(file_key, key) ||
+	    hash != probe_cache_hash()) {
+		PR_INFO("Ignoring probe cache %s\n", path);
+		goto out;
+	}
+
+	while (fscanf(file, "%ms %ms %d", &target_path, &status, &chip_type) == 3) {
+		if (!strcmp(status, "enabled"))
+			probe_cache_add(target_path, PDBG_TARGET_ENABLED, chip_type);
+		else if (!strcmp(status, "nonexistent"))
+			probe_cache_add(target_path, PDBG_TARGET_NONEXISTENT, chip_type);
+		else
+			free(target_path);
+
+		free(status);
+	}
+
+	/* The entries don't move once they have all been read */
+	for (i = 0; i < cache_count; i++)
+		hash_insert(&cache_index, hash_string(cache_entries[i].path),
+			    cache_entries[i].path, &cache_entries[i]);
+
+	cache_valid = true;
+	rc = 0;
+
+out:
+	free(file_key);
+	fclose(file);
+	return rc;
+}
+
+/*
+ * Returns true and sets *status if the result of probing target is known
+ * from the cache. Targets which don't exist never need to be probed but
+ * targets which do are only skipped if probing them only checks that they
+ * are present.
+ */
+bool probe_cache_status(struct pdbg_target *target, enum pdbg_target_status *status)
+{
+	struct probe_cache_entry *entry;
+	struct pdbg_target *fsi;
+	bool cached = false;
+
+	if (!cache_valid)
+		return false;
+
+	pthread_mutex_lock(&cache_lock);
+	if (!cache_valid)
+		goto out;
+
+	/* Probing an FSI is what validates the cache */
+	if (target->class_id == CLASS_NONE || target->class_id == CLASS_FSI)
+		goto out;
+
+	fsi = probe_cache_fsi(target);
+	if (!fsi || !fsi->cache_validated)
+		goto out;
+
+	entry = probe_cache_entry(target);
+	if (!entry)
+		goto out;
+
+	if (entry->status == PDBG_TARGET_NONEXISTENT ||
+	    (entry->status == PDBG_TARGET_ENABLED && target->cacheable_probe)) {
+		*status = entry->status;
+		cached = true;
+	}
+
+out:
+	pthread_mutex_unlock(&cache_lock);
+	return cached;
+}
+
+/*
+ * Called after an FSI has been found to exist to check that the chip behind
+ * it is the same one that was cached.
+ */
+void probe_cache_validate(struct pdbg_target *target)
+{
+	struct probe_cache_entry *entry;
+	struct fsi *fsi;
+	uint32_t value;
+
+	if (!cache_enabled || target->class_id != CLASS_FSI)
+		return;
+
+	/* Not every FSI reads the chip ID when it is probed */
+	fsi = target_to_fsi(target);
+	if (fsi->chip_type == CHIP_UNKNOWN && !fsi_read(target, CFAM_CHIP_ID, &value))
+		fsi->chip_type = get_chip_type(value);
+
+	pthread_mutex_lock(&cache_lock);
+	entry = cache_valid ? probe_cache_entry(target) : NULL;
+	if (entry) {
+		if (entry->status == PDBG_TARGET_ENABLED &&
+		    entry->chip_type == fsi->chip_type) {
+			target->cache_validated = true;
+		} else {
+			PR_INFO("Probe cache is out of date\n");
+			cache_valid = false;
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static void probe_cache_write(FILE *file, struct pdbg_target *target)
+{
+	enum pdbg_target_status status;
+	enum chip_type chip_type = CHIP_UNKNOWN;
+	struct probe_cache_entry *entry = NULL;
+	struct pdbg_target *child;
+	char *path;
+	bool probed;
+
+	status = pdbg_target_status(target);
+	if (status == PDBG_TARGET_RELEASED)
+		status = PDBG_TARGET_ENABLED;
+
+	if (cache_valid && target->parent) {
+		entry = probe_cache_entry(target);
+		if (entry)
+			entry->saved = true;
+	}
+
+	/* Keep the cached result for targets which weren't probed this time */
+	probed = probe_cache_status_name(status);
+	if (!probed)
+		status = entry ? entry->status : PDBG_TARGET_UNKNOWN;
+
+	if (target->class_id == CLASS_FSI)
+		chip_type = probed ? target_to_fsi(target)->chip_type :
+			(entry ? entry->chip_type : CHIP_UNKNOWN);
+
+	if (target->parent && probe_cache_status_name(status)) {
+		path = pdbg_target_path(target);
+		if (path) {
+			fprintf(file, "%s %s %d\n", path,
+				probe_cache_status_name(status), chip_type);
+			free(path);
+		}
+	}
+
+	/* Only walk the targets which have been created, any others can't
+	 * have been probed */
+	list_for_each(&target->children, child, list)
+		probe_cache_write(file, child);
+}
+
+int pdbg_probe_cache_save(void)
+{
+	char *tmp_path;
+	FILE *file;
+	int i, rc = 0;
+
+	if (!cache_enabled)
+		return -1;
+
+	if (asprintf(&tmp_path, "%s.tmp", cache_path) < 0)
+		return -1;
+
+	file = fopen(tmp_path, "w");
+	if (!file) {
+		PR_ERROR("Unable to write probe cache %s\n", tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+
+	fprintf(file, PROBE_CACHE_MAGIC " %d %s %016" PRIx64 "\n",
+		PROBE_CACHE_VERSION, cache_key, probe_cache_hash());
+	for (i = 0; i < cache_count; i++)
+		cache_entries[i].saved = false;
+
+	probe_cache_write(file, pdbg_target_root());
+
+	/* Keep the entries for targets which were never created */
+	for (i = 0; cache_valid && i < cache_count; i++)
+		if (!cache_entries[i].saved)
+			fprintf(file, "%s %s %d\n", cache_entries[i].path,
+				probe_cache_status_name(cache_entries[i].status),
+				cache_entries[i].chip_type);
+
+	if (fclose(file) || rename(tmp_path, cache_path)) {
+		PR_ERROR("Unable to write probe cache %s\n", cache_path);
+		remove(tmp_path);
+		rc = -1;
+	}
+
+	free(tmp_path);
+	return rc;
+}
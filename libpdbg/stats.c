@@ -0,0 +1,204 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Operation counters and latency histograms. Each target gets a set of
+ * counters the first time an operation is recorded against it and keeps
+ * them for the life of the process. Counters are updated with atomics so
+ * that recording an operation never takes a lock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "target.h"
+#include "stats.h"
+
+struct target_stats {
+	struct pdbg_stat ops[PDBG_STAT_OP_COUNT];
+	struct pdbg_target *target;
+	struct target_stats *next;
+};
+
+int stats_enabled;
+
+/* Targets with statistics in the order they were first used */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct target_stats *stats_head;
+static struct target_stats **stats_tail = &stats_head;
+
+static const char *stat_names[PDBG_STAT_OP_COUNT] = {
+	[PDBG_STAT_FSI_READ] = "fsi_read",
+	[PDBG_STAT_FSI_WRITE] = "fsi_write",
+	[PDBG_STAT_PIB_READ] = "pib_read",
+	[PDBG_STAT_PIB_WRITE] = "pib_write",
+	[PDBG_STAT_OPB_READ] = "opb_read",
+	[PDBG_STAT_OPB_WRITE] = "opb_write",
+	[PDBG_STAT_ADU_GETMEM] = "adu_getmem",
+	[PDBG_STAT_ADU_PUTMEM] = "adu_putmem",
+	[PDBG_STAT_RAM] = "ram",
+	[PDBG_STAT_POLL] = "poll",
+	[PDBG_STAT_PROBE] = "probe",
+	[PDBG_STAT_LOCK] = "lock",
+};
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int stats_bucket(uint64_t ns)
+{
+	int bucket;
+
+	if (!ns)
+		return 0;
+
+	bucket = 64 - __builtin_clzll(ns);
+	return bucket < PDBG_STAT_BUCKETS ? bucket : PDBG_STAT_BUCKETS - 1;
+}
+
+static struct target_stats *stats_get(struct pdbg_target *target)
+{
+	struct target_stats *stats;
+
+	stats = __atomic_load_n(&target->stats, __ATOMIC_ACQUIRE);
+	if (stats)
+		return stats;
+
+	pthread_mutex_lock(&stats_lock);
+	stats = target->stats;
+	if (!stats) {
+		stats = calloc(1, sizeof(*stats));
+		assert(stats);
+		stats->target = target;
+		*stats_tail = stats;
+		stats_tail = &stats->next;
+		__atomic_store_n(&target->stats, stats, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	return stats;
+}
+
+void stats_record(struct pdbg_target *target, enum pdbg_stat_op op,
+		  uint64_t start, int rc)
+{
+	struct pdbg_stat *stat;
+	uint64_t end, ns, max;
+	int enabled;
+
+	if (!start)
+		return;
+
+	end = stats_now();
+	enabled = __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED);
+	if (enabled & STATS_TRACE)
+		trace_record(target, op, start, end, rc);
+
+	if (!(enabled & STATS_COUNT))
+		return;
+
+	ns = end - start;
+	stat = &stats_get(target)->ops[op];
+
+	__atomic_fetch_add(&stat->count, 1, __ATOMIC_RELAXED);
+	if (rc)
+		__atomic_fetch_add(&stat->errors, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stat->total_ns, ns, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stat->buckets[stats_bucket(ns)], 1, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&stat->max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&stat->max_ns, &max, ns, false,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void pdbg_stats_enable(bool enable)
+{
+	if (enable)
+		__atomic_or_fetch(&stats_enabled, STATS_COUNT, __ATOMIC_RELAXED);
+	else
+		__atomic_and_fetch(&stats_enabled, ~STATS_COUNT, __ATOMIC_RELAXED);
+}
+
+const char *pdbg_stat_name(enum pdbg_stat_op op)
+{
+	assert(op < PDBG_STAT_OP_COUNT);
+	return stat_names[op];
+}
+
+uint64_t pdbg_stat_bucket_ns(int bucket)
+{
+	assert(bucket >= 0 && bucket < PDBG_STAT_BUCKETS);
+	return bucket ? 1ULL << (bucket - 1) : 0;
+}
+
+static uint64_t stats_take(uint64_t *value, bool reset)
+{
+	return reset ? __atomic_exchange_n(value, 0, __ATOMIC_RELAXED) :
+		__atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+/* Adds the counters in from to those in to */
+static void stats_add(struct pdbg_stat *to, struct pdbg_stat *from, bool reset)
+{
+	uint64_t max;
+	int i;
+
+	to->count += stats_take(&from->count, reset);
+	to->errors += stats_take(&from->errors, reset);
+	to->total_ns += stats_take(&from->total_ns, reset);
+	max = stats_take(&from->max_ns, reset);
+	if (max > to->max_ns)
+		to->max_ns = max;
+
+	for (i = 0; i < PDBG_STAT_BUCKETS; i++)
+		to->buckets[i] += stats_take(&from->buckets[i], reset);
+}
+
+void pdbg_stats_get(struct pdbg_target *target,
+		    struct pdbg_stat stats[PDBG_STAT_OP_COUNT], bool reset)
+{
+	struct target_stats *ts;
+	int op;
+
+	memset(stats, 0, PDBG_STAT_OP_COUNT * sizeof(*stats));
+
+	pthread_mutex_lock(&stats_lock);
+	for (ts = target ? target->stats : stats_head; ts;
+	     ts = target ? NULL : ts->next) {
+		for (op = 0; op < PDBG_STAT_OP_COUNT; op++)
+			stats_add(&stats[op], &ts->ops[op], reset);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+struct pdbg_target *pdbg_stats_next_target(struct pdbg_target *prev)
+{
+	struct target_stats *ts;
+
+	pthread_mutex_lock(&stats_lock);
+	ts = prev ? prev->stats->next : stats_head;
+	pthread_mutex_unlock(&stats_lock);
+
+	return ts ? ts->target : NULL;
+}
@@ -0,0 +1,48 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LIBPDBG_STATS_H
+#define __LIBPDBG_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libpdbg.h"
+
+/* Which of statistics and tracing are enabled */
+#define STATS_COUNT	0x1
+#define STATS_TRACE	0x2
+
+extern int stats_enabled;
+
+uint64_t stats_now(void);
+
+/*
+ * Operations are timed by calling stats_start() before and stats_record()
+ * after them. Neither does anything unless statistics or tracing are
+ * enabled.
+ */
+static inline uint64_t stats_start(void)
+{
+	return __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED) ? stats_now() : 0;
+}
+
+void stats_record(struct pdbg_target *target, enum pdbg_stat_op op,
+		  uint64_t start, int rc);
+
+void trace_record(struct pdbg_target *target, enum pdbg_stat_op op,
+		  uint64_t start, uint64_t end, int rc);
+
+#endif
@@ -2,6 +2,9 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <ccan/list/list.h>
 #include <libfdt/libfdt.h>
 
@@ -9,16 +12,95 @@
 #include "target.h"
 #include "operations.h"
 #include "debug.h"
+#include "hash.h"
+#include "stats.h"
 
 struct list_head empty_list = LIST_HEAD_INIT(empty_list);
 struct list_head target_classes = LIST_HEAD_INIT(target_classes);
 
+/* Number of cores the current thread is waking up. Special wakeup is
+ * requested with SCOMs through the core itself which must not try to wake
+ * it up again. */
+static __thread int cores_waking;
+
+bool core_wakeup_begin(struct core *core, bool try)
+{
+	if (__atomic_load_n(&core->awake, __ATOMIC_ACQUIRE))
+		return false;
+
+	if (try) {
+		if (pthread_mutex_trylock(&core->target.lock))
+			return false;
+	} else {
+		pthread_mutex_lock(&core->target.lock);
+	}
+
+	/* Another thread may have woken it up while we waited */
+	if (core->awake) {
+		pthread_mutex_unlock(&core->target.lock);
+		return false;
+	}
+
+	cores_waking++;
+	return true;
+}
+
+void core_wakeup_end(struct core *core)
+{
+	/* A core is only tried again if special wakeup couldn't be asserted */
+	__atomic_store_n(&core->awake, core->spwkup_asserted, __ATOMIC_RELEASE);
+	cores_waking--;
+	pthread_mutex_unlock(&core->target.lock);
+}
+
+int core_wakeup(struct pdbg_target *target)
+{
+	struct core *core = target_to_core(target);
+	int rc;
+
+	/* Cores are only woken up once they have been probed (which
+	 * itself must not require the core to be woken up) */
+	if (!core->wakeup || cores_waking ||
+	    pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+		return 0;
+
+	if (!core_wakeup_begin(core, false))
+		return 0;
+
+	rc = core->wakeup(core);
+	core_wakeup_end(core);
+
+	return rc;
+}
+
+/* Takes the lock serialising accesses through target, recording how long
+ * it had to wait if another thread held it */
+void target_lock(struct pdbg_target *target)
+{
+	uint64_t start;
+
+	if (!pthread_mutex_trylock(&target->lock))
+		return;
+
+	start = stats_start();
+	pthread_mutex_lock(&target->lock);
+	stats_record(target, PDBG_STAT_LOCK, start, 0);
+}
+
+void target_unlock(struct pdbg_target *target)
+{
+	pthread_mutex_unlock(&target->lock);
+}
+
 /* Work out the address to access based on the current target and
  * final class name */
-static struct pdbg_target *get_class_target_addr(struct pdbg_target *target, const char *name, uint64_t *addr)
+static struct pdbg_target *get_class_target_addr(struct pdbg_target *target, int class_id, uint64_t *addr)
 {
 	/* Check class */
-	while (strcmp(target->class, name)) {
+	while (target->class_id != class_id) {
+		/* Accessing anything within a core requires it to be awake */
+		if (target->class_id == CLASS_CORE)
+			core_wakeup(target);
 
 		if (target->translate)
 			*addr = target->translate(target, *addr);
@@ -38,7 +120,7 @@ static struct pdbg_target *get_class_target_addr(struct pdbg_target *target, con
 
 struct pdbg_target *pdbg_address_absolute(struct pdbg_target *target, uint64_t *addr)
 {
-	return get_class_target_addr(target, "pib", addr);
+	return get_class_target_addr(target, CLASS_PIB, addr);
 }
 
 /* The indirect access code was largely stolen from hw/xscom.c in skiboot */
@@ -121,15 +203,19 @@ static int pib_indirect_write(struct pib *pib, uint64_t addr, uint64_t data)
 int pib_read(struct pdbg_target *pib_dt, uint64_t addr, uint64_t *data)
 {
 	struct pib *pib;
-	uint64_t target_addr = addr;
+	uint64_t target_addr = addr, start;
 	int rc;
 
-	pib_dt = get_class_target_addr(pib_dt, "pib", &target_addr);
+	pib_dt = get_class_target_addr(pib_dt, CLASS_PIB, &target_addr);
 	pib = target_to_pib(pib_dt);
+	start = stats_start();
+	target_lock(pib_dt);
 	if (target_addr & PPC_BIT(0))
 		rc = pib_indirect_read(pib, target_addr, data);
 	else
 		rc = pib->read(pib, target_addr, data);
+	target_unlock(pib_dt);
+	stats_record(pib_dt, PDBG_STAT_PIB_READ, start, rc);
 	PR_DEBUG("addr:0x%08" PRIx64 " data:0x%016" PRIx64 "\n",
 		 target_addr, *data);
 	return rc;
@@ -138,17 +224,21 @@ int pib_read(struct pdbg_target *pib_dt, uint64_t addr, uint64_t *data)
 int pib_write(struct pdbg_target *pib_dt, uint64_t addr, uint64_t data)
 {
 	struct pib *pib;
-	uint64_t target_addr = addr;
+	uint64_t target_addr = addr, start;
 	int rc;
 
-	pib_dt = get_class_target_addr(pib_dt, "pib", &target_addr);
+	pib_dt = get_class_target_addr(pib_dt, CLASS_PIB, &target_addr);
 	pib = target_to_pib(pib_dt);
 	PR_DEBUG("addr:0x%08" PRIx64 " data:0x%016" PRIx64 "\n",
 		 target_addr, data);
+	start = stats_start();
+	target_lock(pib_dt);
 	if (target_addr & PPC_BIT(0))
 		rc = pib_indirect_write(pib, target_addr, data);
 	else
 		rc = pib->write(pib, target_addr, data);
+	target_unlock(pib_dt);
+	stats_record(pib_dt, PDBG_STAT_PIB_WRITE, start, rc);
 	return rc;
 }
 
@@ -156,64 +246,87 @@ int pib_write(struct pdbg_target *pib_dt, uint64_t addr, uint64_t data)
 int pib_wait(struct pdbg_target *pib_dt, uint64_t addr, uint64_t mask, uint64_t data)
 {
 	struct pib *pib;
-	uint64_t tmp;
+	uint64_t tmp, start, poll_start;
 	int rc;
 
-	pib_dt = get_class_target_addr(pib_dt, "pib", &addr);
+	pib_dt = get_class_target_addr(pib_dt, CLASS_PIB, &addr);
 	pib = target_to_pib(pib_dt);
 
+	/* Other threads may use the PIB between polls */
+	poll_start = stats_start();
 	do {
+		start = stats_start();
+		target_lock(pib_dt);
 		if (addr & PPC_BIT(0))
 			rc = pib_indirect_read(pib, addr, &tmp);
 		else
 			rc = pib->read(pib, addr, &tmp);
-		if (rc)
-			return rc;
-	} while ((tmp & mask) != data);
+		target_unlock(pib_dt);
+		stats_record(pib_dt, PDBG_STAT_PIB_READ, start, rc);
+	} while (!rc && (tmp & mask) != data);
 
-	return 0;
+	stats_record(pib_dt, PDBG_STAT_POLL, poll_start, rc);
+	return rc;
 }
 
 int opb_read(struct pdbg_target *opb_dt, uint32_t addr, uint32_t *data)
 {
 	struct opb *opb;
-	uint64_t addr64 = addr;
+	uint64_t addr64 = addr, start;
+	int rc;
 
-	opb_dt = get_class_target_addr(opb_dt, "opb", &addr64);
+	opb_dt = get_class_target_addr(opb_dt, CLASS_OPB, &addr64);
 	opb = target_to_opb(opb_dt);
-	return opb->read(opb, addr64, data);
+	start = stats_start();
+	rc = opb->read(opb, addr64, data);
+	stats_record(opb_dt, PDBG_STAT_OPB_READ, start, rc);
+	return rc;
 }
 
 int opb_write(struct pdbg_target *opb_dt, uint32_t addr, uint32_t data)
 {
 	struct opb *opb;
-	uint64_t addr64 = addr;
+	uint64_t addr64 = addr, start;
+	int rc;
 
-	opb_dt = get_class_target_addr(opb_dt, "opb", &addr64);
+	opb_dt = get_class_target_addr(opb_dt, CLASS_OPB, &addr64);
 	opb = target_to_opb(opb_dt);
-
-	return opb->write(opb, addr64, data);
+	start = stats_start();
+	rc = opb->write(opb, addr64, data);
+	stats_record(opb_dt, PDBG_STAT_OPB_WRITE, start, rc);
+	return rc;
 }
 
 int fsi_read(struct pdbg_target *fsi_dt, uint32_t addr, uint32_t *data)
 {
 	struct fsi *fsi;
-	uint64_t addr64 = addr;
+	uint64_t addr64 = addr, start;
+	int rc;
 
-	fsi_dt = get_class_target_addr(fsi_dt, "fsi", &addr64);
+	fsi_dt = get_class_target_addr(fsi_dt, CLASS_FSI, &addr64);
 	fsi = target_to_fsi(fsi_dt);
-	return fsi->read(fsi, addr64, data);
+	start = stats_start();
+	target_lock(fsi_dt);
+	rc = fsi->read(fsi, addr64, data);
+	target_unlock(fsi_dt);
+	stats_record(fsi_dt, PDBG_STAT_FSI_READ, start, rc);
+	return rc;
 }
 
 int fsi_write(struct pdbg_target *fsi_dt, uint32_t addr, uint32_t data)
 {
 	struct fsi *fsi;
-	uint64_t addr64 = addr;
+	uint64_t addr64 = addr, start;
+	int rc;
 
-	fsi_dt = get_class_target_addr(fsi_dt, "fsi", &addr64);
+	fsi_dt = get_class_target_addr(fsi_dt, CLASS_FSI, &addr64);
 	fsi = target_to_fsi(fsi_dt);
-
-	return fsi->write(fsi, addr64, data);
+	start = stats_start();
+	target_lock(fsi_dt);
+	rc = fsi->write(fsi, addr64, data);
+	target_unlock(fsi_dt);
+	stats_record(fsi_dt, PDBG_STAT_FSI_WRITE, start, rc);
+	return rc;
 }
 
 struct pdbg_target *require_target_parent(struct pdbg_target *target)
@@ -222,16 +335,80 @@ struct pdbg_target *require_target_parent(struct pdbg_target *target)
 	return target->parent;
 }
 
+/*
+ * Classes indexed by name and by ID. target_class_lock protects creating
+ * classes as well as the index of each class's targets below, so classes
+ * may be looked up and targets iterated from several threads while others
+ * expand the tree.
+ */
+static pthread_rwlock_t target_class_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct hash_table target_class_index = HASH_TABLE_INIT(hash_string_equal);
+static struct pdbg_target_class **target_class_ids;
+static int target_class_ids_size;
+static int target_class_count = CLASS_BUILTIN_COUNT;
+
+static const char *builtin_classes[CLASS_BUILTIN_COUNT] = {
+	[CLASS_FSI] = "fsi",
+	[CLASS_PIB] = "pib",
+	[CLASS_OPB] = "opb",
+	[CLASS_CORE] = "core",
+	[CLASS_THREAD] = "thread",
+	[CLASS_CHIPLET] = "chiplet",
+	[CLASS_ADU] = "adu",
+	[CLASS_NHTM] = "nhtm",
+	[CLASS_CHTM] = "chtm",
+	[CLASS_XBUS] = "xbus",
+};
+
+/* Returns the ID of a builtin class or -1 if name isn't one */
+static int builtin_class_id(const char *name)
+{
+	int i;
+
+	for (i = CLASS_NONE + 1; i < CLASS_BUILTIN_COUNT; i++)
+		if (!strcmp(builtin_classes[i], name))
+			return i;
+
+	return -1;
+}
+
+uint64_t target_class_bit(const char *name)
+{
+	int id = builtin_class_id(name);
+
+	return 1ULL << (id > CLASS_NONE ? id : CLASS_NONE);
+}
+
+static int target_class_id(const char *name)
+{
+	int id = builtin_class_id(name);
+
+	return id >= 0 ? id : target_class_count++;
+}
+
+static struct pdbg_target_class *__find_target_class(const char *name)
+{
+	return hash_find(&target_class_index, hash_string(name), name);
+}
+
+static struct pdbg_target_class *__get_target_class_by_id(int id)
+{
+	if (id <= CLASS_NONE || id >= target_class_ids_size)
+		return NULL;
+
+	return target_class_ids[id];
+}
+
 /* Finds the given class. Returns NULL if not found. */
 struct pdbg_target_class *find_target_class(const char *name)
 {
 	struct pdbg_target_class *target_class;
 
-	list_for_each(&target_classes, target_class, class_head_link)
-		if (!strcmp(target_class->name, name))
-			return target_class;
+	pthread_rwlock_rdlock(&target_class_lock);
+	target_class = __find_target_class(name);
+	pthread_rwlock_unlock(&target_class_lock);
 
-	return NULL;
+	return target_class;
 }
 
 /* Same as above but dies with an assert if the target class doesn't
@@ -253,33 +430,216 @@ struct pdbg_target_class *get_target_class(const char *name)
 {
 	struct pdbg_target_class *target_class;
 
-	if ((target_class = find_target_class(name)))
+	pthread_rwlock_wrlock(&target_class_lock);
+	if ((target_class = __find_target_class(name))) {
+		pthread_rwlock_unlock(&target_class_lock);
 		return target_class;
+	}
 
 	/* Need to allocate a new class */
 	PR_DEBUG("Allocating %s target class\n", name);
 	target_class = calloc(1, sizeof(*target_class));
 	assert(target_class);
 	target_class->name = strdup(name);
+	target_class->id = target_class_id(name);
 	list_head_init(&target_class->targets);
 	list_add_tail(&target_classes, &target_class->class_head_link);
+	hash_insert(&target_class_index, hash_string(target_class->name),
+		    target_class->name, target_class);
+
+	/* Classes which haven't been created yet have no entry */
+	if (target_class_ids_size < target_class_count) {
+		target_class_ids = realloc(target_class_ids,
+					   target_class_count * sizeof(*target_class_ids));
+		assert(target_class_ids);
+		memset(&target_class_ids[target_class_ids_size], 0,
+		       (target_class_count - target_class_ids_size) * sizeof(*target_class_ids));
+		target_class_ids_size = target_class_count;
+	}
+	target_class_ids[target_class->id] = target_class;
+	pthread_rwlock_unlock(&target_class_lock);
+
+	return target_class;
+}
+
+/* Returns the class with the given ID or NULL if there isn't one */
+struct pdbg_target_class *get_target_class_by_id(int id)
+{
+	struct pdbg_target_class *target_class;
+
+	pthread_rwlock_rdlock(&target_class_lock);
+	target_class = __get_target_class_by_id(id);
+	pthread_rwlock_unlock(&target_class_lock);
+
 	return target_class;
 }
 
+/*
+ * Each class keeps an index of its targets in tree order. As the
+ * descendants of any target are contiguous in tree order the targets of a
+ * class below a given parent are found by searching for the first one and
+ * then walking the index until the end of the parent's subtree.
+ *
+ * The generation is bumped each time targets are added to the tree and the
+ * index is rebuilt when it was built for an older generation. Only targets
+ * whose children have all been created are walked so that the rebuild
+ * doesn't need the tree lock. If targets are added during a rebuild the
+ * generation it records is already old and the next reader rebuilds again.
+ */
+static uint32_t target_tree_gen = 1;
+static uint32_t target_class_index_gen;
+
+static void target_class_index_add(struct pdbg_target *target, uint32_t *pos)
+{
+	struct pdbg_target_class *target_class;
+	struct pdbg_target *child;
+
+	target->tree_pos = (*pos)++;
+
+	target_class = __get_target_class_by_id(target->class_id);
+	if (target_class) {
+		if (target_class->count == target_class->size) {
+			target_class->size = target_class->size ? target_class->size * 2 : 16;
+			target_class->index = realloc(target_class->index,
+						      target_class->size * sizeof(*target_class->index));
+			assert(target_class->index);
+		}
+
+		target->class_pos = target_class->count;
+		target_class->index[target_class->count++] = target;
+	}
+
+	if (__atomic_load_n(&target->expanded, __ATOMIC_ACQUIRE))
+		list_for_each(&target->children, child, list)
+			target_class_index_add(child, pos);
+
+	target->tree_end = *pos - 1;
+}
+
+/* Called with target_class_lock held for writing */
+static void __target_class_index_update(void)
+{
+	struct pdbg_target_class *target_class;
+	uint32_t pos = 0, gen;
+
+	gen = __atomic_load_n(&target_tree_gen, __ATOMIC_ACQUIRE);
+	if (target_class_index_gen == gen || !pdbg_target_root())
+		return;
+
+	list_for_each(&target_classes, target_class, class_head_link)
+		target_class->count = 0;
+
+	target_class_index_add(pdbg_target_root(), &pos);
+	target_class_index_gen = gen;
+}
+
+static bool target_class_index_current(void)
+{
+	return target_class_index_gen == __atomic_load_n(&target_tree_gen, __ATOMIC_ACQUIRE) ||
+		!pdbg_target_root();
+}
+
+void target_class_index_update(void)
+{
+	target_class_index_lock();
+	target_class_index_unlock();
+}
+
+void target_class_index_lock(void)
+{
+	pthread_rwlock_rdlock(&target_class_lock);
+	while (!target_class_index_current()) {
+		pthread_rwlock_unlock(&target_class_lock);
+
+		pthread_rwlock_wrlock(&target_class_lock);
+		__target_class_index_update();
+		pthread_rwlock_unlock(&target_class_lock);
+
+		pthread_rwlock_rdlock(&target_class_lock);
+	}
+}
+
+void target_class_index_unlock(void)
+{
+	pthread_rwlock_unlock(&target_class_lock);
+}
+
+struct pdbg_target_class *target_class_index_find(const char *name)
+{
+	return __find_target_class(name);
+}
+
+struct pdbg_target_class *target_class_index_get(int id)
+{
+	return __get_target_class_by_id(id);
+}
+
+void target_class_index_invalidate(void)
+{
+	__atomic_add_fetch(&target_tree_gen, 1, __ATOMIC_RELEASE);
+}
+
+int pdbg_target_class_id(struct pdbg_target *target)
+{
+	return target->class_id;
+}
+
+int pdbg_class_id(const char *klass)
+{
+	struct pdbg_target_class *target_class = find_target_class(klass);
+
+	if (target_class)
+		return target_class->id;
+
+	/* Builtin classes have an ID even without any targets */
+	return builtin_class_id(klass);
+}
+
 extern struct hw_unit_info *__start_hw_units;
 extern struct hw_init_info *__stop_hw_units;
-struct hw_unit_info *find_compatible_target(const char *compat)
+
+/* Hardware units indexed by compatible string, built on first use */
+static struct hash_table compatible_index = HASH_TABLE_INIT(hash_string_equal);
+static pthread_once_t compatible_index_once = PTHREAD_ONCE_INIT;
+
+static void compatible_index_init(void)
 {
 	struct hw_unit_info **p;
 	struct pdbg_target *target;
+	uint32_t hash;
 
 	for (p = &__start_hw_units; p < (struct hw_unit_info **) &__stop_hw_units; p++) {
 		target = (*p)->hw_unit;
-		if (!strcmp(target->compatible, compat))
-			return *p;
+		hash = hash_string(target->compatible);
+
+		/* The first unit with a given compatible wins */
+		if (!hash_find(&compatible_index, hash, target->compatible))
+			hash_insert(&compatible_index, hash, target->compatible, *p);
 	}
+}
 
-	return NULL;
+struct hw_unit_info *find_compatible_target(const char *compat)
+{
+	pthread_once(&compatible_index_once, compatible_index_init);
+
+	return hash_find(&compatible_index, hash_string(compat), compat);
+}
+
+/*
+ * Targets may be probed from several threads at once. Only one thread
+ * probes any given target while the others wait for it to finish.
+ */
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_cond = PTHREAD_COND_INITIALIZER;
+static bool parallel_probe;
+
+static void probe_status_set(struct pdbg_target *target, enum pdbg_target_status status)
+{
+	pthread_mutex_lock(&probe_lock);
+	__atomic_store_n(&target->status, status, __ATOMIC_RELEASE);
+	target->probing = false;
+	pthread_cond_broadcast(&probe_cond);
+	pthread_mutex_unlock(&probe_lock);
 }
 
 /* We walk the tree root down disabling targets which might/should
@@ -288,6 +648,8 @@ enum pdbg_target_status pdbg_target_probe(struct pdbg_target *target)
 {
 	struct pdbg_target *parent;
 	enum pdbg_target_status status;
+	uint64_t start;
+	int rc;
 
 	assert(target);
 
@@ -309,7 +671,7 @@ enum pdbg_target_status pdbg_target_probe(struct pdbg_target *target)
 		case PDBG_TARGET_NONEXISTENT:
 			/* The parent doesn't exist neither does it's
 			 * children */
-			target->status = PDBG_TARGET_NONEXISTENT;
+			probe_status_set(target, PDBG_TARGET_NONEXISTENT);
 			return PDBG_TARGET_NONEXISTENT;
 
 		case PDBG_TARGET_DISABLED:
@@ -332,18 +694,177 @@ enum pdbg_target_status pdbg_target_probe(struct pdbg_target *target)
 		}
 	}
 
+	/* Another thread may be probing this target already in which case
+	 * wait for it rather than probing it again */
+	pthread_mutex_lock(&probe_lock);
+	while (target->probing)
+		pthread_cond_wait(&probe_cond, &probe_lock);
+
+	status = target->status;
+	if (status == PDBG_TARGET_DISABLED || status == PDBG_TARGET_NONEXISTENT
+	    || status == PDBG_TARGET_ENABLED) {
+		pthread_mutex_unlock(&probe_lock);
+		return status;
+	}
+	target->probing = true;
+	pthread_mutex_unlock(&probe_lock);
+
+	/* Skip probing targets whose status is known from a previous run */
+	if (status != PDBG_TARGET_MUSTEXIST && probe_cache_status(target, &status)) {
+		probe_status_set(target, status);
+		return status;
+	}
+
 	/* At this point any parents must exist and have already been probed */
-	if (target->probe && target->probe(target)) {
-		/* Could not find the target */
-		assert(pdbg_target_status(target) != PDBG_TARGET_MUSTEXIST);
-		target->status = PDBG_TARGET_NONEXISTENT;
-		return PDBG_TARGET_NONEXISTENT;
+	if (target->probe) {
+		start = stats_start();
+		rc = target->probe(target);
+		stats_record(target, PDBG_STAT_PROBE, start, rc);
+		if (rc) {
+			/* Could not find the target */
+			assert(status != PDBG_TARGET_MUSTEXIST);
+			probe_status_set(target, PDBG_TARGET_NONEXISTENT);
+			return PDBG_TARGET_NONEXISTENT;
+		}
 	}
 
-	target->status = PDBG_TARGET_ENABLED;
+	probe_cache_validate(target);
+	probe_status_set(target, PDBG_TARGET_ENABLED);
 	return PDBG_TARGET_ENABLED;
 }
 
+void pdbg_set_parallel_probe(bool enable)
+{
+	parallel_probe = enable;
+}
+
+struct probe_group {
+	pthread_t tid;
+	bool started;
+	struct pdbg_target *root;
+	struct pdbg_target **targets;
+	int count;
+};
+
+/* Targets behind different FSI links or PIBs can be probed independently */
+static struct pdbg_target *probe_root(struct pdbg_target *target)
+{
+	for (; target; target = target->parent) {
+		if (target->class_id == CLASS_FSI || target->class_id == CLASS_PIB)
+			return target;
+	}
+
+	return NULL;
+}
+
+static void *probe_group(void *arg)
+{
+	struct probe_group *group = arg;
+	int i;
+
+	for (i = 0; i < group->count; i++)
+		pdbg_target_probe(group->targets[i]);
+
+	return NULL;
+}
+
+/*
+ * Probe a list of targets. If parallel probing is enabled the targets are
+ * grouped by the FSI or PIB they are behind and each group is probed in its
+ * own thread.
+ */
+void pdbg_target_probe_list(struct pdbg_target *targets[], int count)
+{
+	struct probe_group *groups = NULL;
+	struct pdbg_target *root;
+	int i, j, ngroups = 0;
+
+	if (!parallel_probe) {
+		for (i = 0; i < count; i++)
+			pdbg_target_probe(targets[i]);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		root = probe_root(targets[i]);
+		for (j = 0; j < ngroups; j++)
+			if (groups[j].root == root)
+				break;
+
+		if (j == ngroups) {
+			groups = realloc(groups, (ngroups + 1) * sizeof(*groups));
+			assert(groups);
+			memset(&groups[j], 0, sizeof(*groups));
+			groups[j].root = root;
+			ngroups++;
+		}
+
+		groups[j].targets = realloc(groups[j].targets,
+					    (groups[j].count + 1) * sizeof(*groups[j].targets));
+		assert(groups[j].targets);
+		groups[j].targets[groups[j].count++] = targets[i];
+	}
+
+	/* Probing can walk the targets below the ones being probed. Create
+	 * them all now so that the tree isn't changed by several threads. */
+	for (i = 0; i < count; i++)
+		dt_expand_subtree(targets[i]);
+	target_class_index_update();
+
+	/* Fall back to probing in this thread if a worker can't be started */
+	for (i = 0; i < ngroups; i++) {
+		groups[i].started = ngroups > 1 &&
+			!pthread_create(&groups[i].tid, NULL, probe_group, &groups[i]);
+		if (!groups[i].started)
+			probe_group(&groups[i]);
+	}
+
+	for (i = 0; i < ngroups; i++) {
+		if (groups[i].started)
+			pthread_join(groups[i].tid, NULL);
+		free(groups[i].targets);
+	}
+	free(groups);
+}
+
+/*
+ * Some targets need time to settle after they have been released. Rather
+ * than waiting after each one they request a delay with
+ * pdbg_release_delay() and the outermost pdbg_target_release() waits once
+ * for the longest outstanding delay after everything has been released.
+ * Each thread waits for the delays requested by its own releases.
+ */
+static __thread int release_depth;
+static __thread struct timespec release_settle;
+
+void pdbg_release_delay(unsigned int usecs)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += usecs / 1000000;
+	ts.tv_nsec += (usecs % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	if (ts.tv_sec > release_settle.tv_sec ||
+	    (ts.tv_sec == release_settle.tv_sec && ts.tv_nsec > release_settle.tv_nsec))
+		release_settle = ts;
+}
+
+static void release_settle_wait(void)
+{
+	if (!release_settle.tv_sec && !release_settle.tv_nsec)
+		return;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &release_settle, NULL) == EINTR);
+
+	release_settle.tv_sec = 0;
+	release_settle.tv_nsec = 0;
+}
+
 /* Releases a target by first recursively releasing all its children */
 void pdbg_target_release(struct pdbg_target *target)
 {
@@ -352,13 +873,32 @@ void pdbg_target_release(struct pdbg_target *target)
 	if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
 		return;
 
+	release_depth++;
+
 	pdbg_for_each_child_target(target, child)
 		pdbg_target_release(child);
 
 	/* Release the target */
 	if (target->release)
 		target->release(target);
-	target->status = PDBG_TARGET_RELEASED;
+	__atomic_store_n(&target->status, PDBG_TARGET_RELEASED, __ATOMIC_RELEASE);
+
+	if (!--release_depth)
+		release_settle_wait();
+}
+
+static void probe_all_collect(struct pdbg_target *parent,
+			      struct pdbg_target ***targets, int *count)
+{
+	struct pdbg_target *child;
+
+	pdbg_for_each_child_target(parent, child) {
+		probe_all_collect(child, targets, count);
+
+		*targets = realloc(*targets, (*count + 1) * sizeof(**targets));
+		assert(*targets);
+		(*targets)[(*count)++] = child;
+	}
 }
 
 /*
@@ -366,11 +906,19 @@ void pdbg_target_release(struct pdbg_target *target)
  */
 void pdbg_target_probe_all(struct pdbg_target *parent)
 {
-	struct pdbg_target *child;
+	struct pdbg_target *child, **targets = NULL;
+	int count = 0;
 
 	if (!parent)
 		parent = pdbg_target_root();
 
+	if (parallel_probe) {
+		probe_all_collect(parent, &targets, &count);
+		pdbg_target_probe_list(targets, count);
+		free(targets);
+		return;
+	}
+
 	pdbg_for_each_child_target(parent, child) {
 		pdbg_target_probe_all(child);
 		pdbg_target_probe(child);
@@ -381,7 +929,7 @@ bool pdbg_target_is_class(struct pdbg_target *target, const char *class)
 {
 	if (!target || !target->class || !class)
 		return false;
-	return strcmp(target->class, class) == 0;
+	return target->class_id == pdbg_class_id(class);
 }
 
 void *pdbg_target_priv(struct pdbg_target *target)
@@ -17,6 +17,7 @@
 #define __TARGET_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include <ccan/list/list.h>
 #include <ccan/str/str.h>
 #include <ccan/container_of/container_of.h>
@@ -25,16 +26,45 @@
 
 enum chip_type {CHIP_UNKNOWN, CHIP_P8, CHIP_P8NV, CHIP_P9};
 
+/* Classes used within libpdbg have fixed IDs so they can be checked without
+ * comparing strings. Other classes are given IDs as they are found. Targets
+ * without a class have an ID of CLASS_NONE. */
+enum {
+	CLASS_NONE = 0,
+	CLASS_FSI,
+	CLASS_PIB,
+	CLASS_OPB,
+	CLASS_CORE,
+	CLASS_THREAD,
+	CLASS_CHIPLET,
+	CLASS_ADU,
+	CLASS_NHTM,
+	CLASS_CHTM,
+	CLASS_XBUS,
+	CLASS_BUILTIN_COUNT,
+};
+
+/* Returns the bit for a class in a mask of classes. Classes which aren't
+ * builtin share the bit of CLASS_NONE. */
+uint64_t target_class_bit(const char *name);
+
 struct pdbg_target_class {
 	char *name;
+	int id;
 	struct list_head targets;
 	struct list_node class_head_link;
+
+	/* The targets of this class in tree order, see target_class_index_update() */
+	struct pdbg_target **index;
+	uint32_t count;
+	uint32_t size;
 };
 
 struct pdbg_target {
 	char *name;
 	char *compatible;
 	char *class;
+	int class_id;
 	int (*probe)(struct pdbg_target *target);
 	void (*release)(struct pdbg_target *target);
 	uint64_t (*translate)(struct pdbg_target *target, uint64_t addr);
@@ -46,17 +76,84 @@ struct pdbg_target {
 	struct list_head children;
 	struct pdbg_target *parent;
 	u32 phandle;
-	bool probed;
+	bool probing;
 	struct list_node class_link;
 	void *priv;
+
+	/* Offset of this target in the FDT and whether its children, or
+	 * everything below it, have been created from the FDT yet */
+	int fdt_offset;
+	bool expanded;
+	bool subtree_expanded;
+
+	/* Classes, see target_class_bit(), whose targets below this one have
+	 * all been created */
+	uint64_t expanded_classes;
+
+	/* Position of this target in a depth first walk of the tree, of its
+	 * last descendant and of this target within its class index */
+	uint32_t tree_pos;
+	uint32_t tree_end;
+	uint32_t class_pos;
+
+	/* Set by hw units whose probe only checks that the target is present
+	 * so that it can be skipped if the target is in the probe cache */
+	bool cacheable_probe;
+
+	/* Set on an FSI once the chip behind it matches the probe cache */
+	bool cache_validated;
+
+	/* Serialises accesses through an FSI, PIB or ADU target so that
+	 * different chips can be accessed from different threads at once */
+	pthread_mutex_t lock;
+
+	/* Operation statistics, allocated when the first one is recorded */
+	struct target_stats *stats;
 };
 
 struct pdbg_target *require_target_parent(struct pdbg_target *target);
 struct pdbg_target_class *find_target_class(const char *name);
 struct pdbg_target_class *require_target_class(const char *name);
 struct pdbg_target_class *get_target_class(const char *name);
+struct pdbg_target_class *get_target_class_by_id(int id);
+void target_class_index_update(void);
+void target_class_index_invalidate(void);
+
+/* Brings the class indexes up to date and holds them so they can be read.
+ * Classes are looked up with target_class_index_find() and
+ * target_class_index_get() while they are held. */
+void target_class_index_lock(void);
+void target_class_index_unlock(void);
+struct pdbg_target_class *target_class_index_find(const char *name);
+struct pdbg_target_class *target_class_index_get(int id);
 bool pdbg_target_is_class(struct pdbg_target *target, const char *class);
 
+/* The device tree the targets were created from */
+const void *pdbg_targets_fdt(void);
+
+/* Create targets from the device tree which haven't been created yet, see
+ * pdbg_set_lazy_expand() */
+void dt_expand_children(struct pdbg_target *node);
+void dt_expand_subtree(struct pdbg_target *node);
+void dt_expand_class(struct pdbg_target *node, const char *klass);
+
+/* Probe cache lookups and validation used while probing, see probecache.c */
+bool probe_cache_status(struct pdbg_target *target, enum pdbg_target_status *status);
+void probe_cache_validate(struct pdbg_target *target);
+
+/* Assert special wakeup on a probed core if it hasn't already been. This
+ * is done automatically on the first SCOM access within the core. */
+int core_wakeup(struct pdbg_target *target);
+
+/* Serialise accesses through an FSI, PIB or ADU target */
+void target_lock(struct pdbg_target *target);
+void target_unlock(struct pdbg_target *target);
+
+/* Request that the current release does not complete until usecs have
+ * passed. Used by release functions which need to let hardware settle so
+ * that many targets can be released with a single wait. */
+void pdbg_release_delay(unsigned int usecs);
+
 /* This works and should be safe because struct pdbg_target is guaranteed to be
  * the first member of the specialised type (see the DECLARE_HW_UNIT definition
  * below). I'm not sure how sane it is though. Probably not very but it does
@@ -138,9 +235,54 @@ struct fsi {
 struct core {
 	struct pdbg_target target;
 	bool release_spwkup;
+
+	/* Optional core wide thread control. Bit n of the thread mask
+	 * selects the thread with id n. These allow all selected threads
+	 * on a core to be controlled with a single write. step_threads()
+	 * clears the bits of threads it couldn't step. */
+	int (*start_threads)(struct core *, uint64_t thread_mask);
+	int (*stop_threads)(struct core *, uint64_t thread_mask);
+	int (*step_threads)(struct core *, uint64_t *thread_mask, int count);
+
+	/* Optional two phase stop. stop_prepare() returns the core relative
+	 * SCOM write which stops the threads in thread_mask without issuing
+	 * it so that the writes for many cores can be issued back to back.
+	 * stop_wait() then waits for the threads to quiesce. */
+	int (*stop_prepare)(struct core *, uint64_t thread_mask, uint64_t *addr, uint64_t *value);
+	int (*stop_wait)(struct core *, uint64_t thread_mask);
+
+	/* Special wakeup is only asserted when the core is first accessed
+	 * after being probed. wakeup() asserts it, waits for it to complete
+	 * and snapshots the thread status. It is called with the core's
+	 * lock held and awake is set once it returns. */
+	int (*wakeup)(struct core *);
+	bool awake;
+
+	/* Optional. Re-reads the status of every thread on the core into
+	 * the snapshot returned by thread_status(). */
+	int (*thread_status)(struct core *);
+
+	/* Optional split special wakeup used to wake many cores at once.
+	 * spwkup_assert() requests special wakeup without waiting for it.
+	 * spwkup_done() returns 1 once special wakeup has completed, 0 if it
+	 * is still in progress and negative on error. It is polled every
+	 * millisecond for at most spwkup_timeout milliseconds. */
+	bool spwkup_asserted;
+	bool spwkup_complete;
+	int (*spwkup_assert)(struct core *);
+	int (*spwkup_done)(struct core *);
+	int spwkup_timeout;
 };
 #define target_to_core(x) container_of(x, struct core, target)
 
+/* Used to wake up a core without core_wakeup(). Returns true with the
+ * core's lock held if the core still needs waking up. If try is set it
+ * doesn't wait for another thread which is waking the core up. Until
+ * core_wakeup_end() is called other threads accessing the core wait for
+ * it to finish waking up. */
+bool core_wakeup_begin(struct core *core, bool try);
+void core_wakeup_end(struct core *core);
+
 struct thread {
 	struct pdbg_target target;
 	struct thread_state status;
@@ -150,6 +292,14 @@ struct thread {
 	int (*stop)(struct thread *);
 	int (*sreset)(struct thread *);
 
+	/* step_setup() should be called prior to using step_once() to step
+	 * a single instruction. step_destroy() should be called at
+	 * completion to clean-up. These allow many steps to be done without
+	 * setting up stepping each time. */
+	int (*step_setup)(struct thread *);
+	int (*step_once)(struct thread *);
+	int (*step_destroy)(struct thread *);
+
 	bool ram_did_quiesce; /* was the thread quiesced by ram mode */
 
 	/* ram_setup() should be called prior to using ram_instruction() to
@@ -0,0 +1,214 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timeline of operations for viewing in chrome://tracing or Perfetto. Each
+ * thread records the start and end of its operations into its own ring
+ * buffer so recording never takes a lock or waits for another thread. Ring
+ * buffers are added to a list the first time a thread records an event and
+ * are kept after the thread exits so its events can still be written out.
+ * A thread which starts later takes over the ring of one which has exited
+ * rather than allocating another, so the number of rings is bounded by the
+ * number of threads running at once.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "target.h"
+#include "debug.h"
+#include "hash.h"
+#include "stats.h"
+
+/* Must be a power of two */
+#define TRACE_RING_SIZE		65536
+
+struct trace_event {
+	uint64_t start;
+	uint64_t end;
+	struct pdbg_target *target;
+	enum pdbg_stat_op op;
+	int rc;
+	pid_t tid;
+};
+
+struct trace_ring {
+	struct trace_ring *next;
+
+	/* Cleared once the owning thread exits */
+	bool in_use;
+
+	/* Number of events ever recorded, only written by the owning thread */
+	uint64_t head;
+	struct trace_event events[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *trace_rings;
+static __thread struct trace_ring *trace_ring;
+static __thread pid_t trace_tid;
+
+static pthread_key_t trace_ring_key;
+static pthread_once_t trace_ring_once = PTHREAD_ONCE_INIT;
+
+/* Called as a thread exits to let another thread take over its ring */
+static void trace_ring_put(void *arg)
+{
+	struct trace_ring *ring = arg;
+
+	__atomic_store_n(&ring->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void trace_ring_key_init(void)
+{
+	if (pthread_key_create(&trace_ring_key, trace_ring_put))
+		PR_WARNING("Trace buffers won't be reused after threads exit\n");
+}
+
+static struct trace_ring *trace_ring_get(void)
+{
+	struct trace_ring *ring = trace_ring;
+	bool in_use;
+
+	if (ring)
+		return ring;
+
+	pthread_once(&trace_ring_once, trace_ring_key_init);
+
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		in_use = false;
+		if (__atomic_compare_exchange_n(&ring->in_use, &in_use, true, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(*ring));
+		if (!ring)
+			return NULL;
+
+		ring->in_use = true;
+		ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, false,
+						    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	pthread_setspecific(trace_ring_key, ring);
+	trace_tid = syscall(SYS_gettid);
+	trace_ring = ring;
+	return ring;
+}
+
+void trace_record(struct pdbg_target *target, enum pdbg_stat_op op,
+		  uint64_t start, uint64_t end, int rc)
+{
+	struct trace_ring *ring = trace_ring_get();
+	struct trace_event *event;
+	uint64_t head;
+
+	if (!ring)
+		return;
+
+	head = ring->head;
+	event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+	event->start = start;
+	event->end = end;
+	event->target = target;
+	event->op = op;
+	event->rc = rc;
+	event->tid = trace_tid;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void pdbg_trace_enable(bool enable)
+{
+	if (enable)
+		__atomic_or_fetch(&stats_enabled, STATS_TRACE, __ATOMIC_RELAXED);
+	else
+		__atomic_and_fetch(&stats_enabled, ~STATS_TRACE, __ATOMIC_RELAXED);
+}
+
+static bool trace_target_equal(const void *a, const void *b)
+{
+	return a == b;
+}
+
+/* Paths are looked up once per target rather than once per event */
+static const char *trace_target_path(struct hash_table *paths,
+				     struct pdbg_target *target)
+{
+	uint32_t hash = hash_pointer(target, 0);
+	char *path;
+
+	path = hash_find(paths, hash, target);
+	if (!path) {
+		path = pdbg_target_path(target);
+		if (!path)
+			return "?";
+		hash_insert(paths, hash, target, path);
+	}
+
+	return path;
+}
+
+int pdbg_trace_write(const char *path)
+{
+	static struct hash_table paths = HASH_TABLE_INIT(trace_target_equal);
+	struct trace_ring *ring;
+	struct trace_event *event;
+	uint64_t head, i;
+	bool first = true;
+	FILE *file;
+	pid_t pid = getpid();
+
+	file = fopen(path, "w");
+	if (!file) {
+		PR_ERROR("Unable to write trace %s\n", path);
+		return -1;
+	}
+
+	fprintf(file, "{\"traceEvents\":[");
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (head > TRACE_RING_SIZE)
+			PR_WARNING("Lost the oldest %" PRIu64 " events\n",
+				   head - TRACE_RING_SIZE);
+
+		for (i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0; i < head; i++) {
+			event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+			fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"pdbg\",\"ph\":\"X\","
+				"\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 ","
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"target\":\"%s\",\"rc\":%d}}",
+				first ? "" : ",", pdbg_stat_name(event->op),
+				event->start / 1000, event->start % 1000,
+				(event->end - event->start) / 1000,
+				(event->end - event->start) % 1000,
+				pid, event->tid,
+				trace_target_path(&paths, event->target), event->rc);
+			first = false;
+		}
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	if (fclose(file)) {
+		PR_ERROR("Unable to write trace %s\n", path);
+		return -1;
+	}
+
+	return 0;
+}
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <ccan/array_size/array_size.h>
 
@@ -41,6 +42,8 @@
 #include "pdbgproxy.h"
 #include "util.h"
 #include "path.h"
+#include "pdbgd.h"
+#include "stats.h"
 
 #define PR_ERROR(x, args...) \
 	pdbg_log(PDBG_ERROR, x, ##args)
@@ -65,9 +68,24 @@
 #define THREADS_PER_CORE	8
 
 static enum backend backend = KERNEL;
+static const char *backend_names[] = {
+	[FSI] = "fsi",
+	[I2C] = "i2c",
+	[KERNEL] = "kernel",
+	[FAKE] = "fake",
+	[HOST] = "host",
+};
 
 static char const *device_node;
 static int i2c_addr = 0x50;
+static const char *probe_cache;
+static const char *script;
+static bool stats;
+static const char *trace_file;
+
+/* Long options without a short form */
+#define OPT_STATS	0x100
+#define OPT_TRACE	0x101
 
 #define MAX_PROCESSORS 64
 #define MAX_CHIPS 24
@@ -93,7 +111,7 @@ extern struct optcmd_cmd
 	optcmd_threadstatus, optcmd_sreset, optcmd_regs, optcmd_probe,
 	optcmd_getmem, optcmd_putmem, optcmd_getmemio, optcmd_putmemio,
 	optcmd_getxer, optcmd_putxer, optcmd_getcr, optcmd_putcr,
-	optcmd_gdbserver;
+	optcmd_gdbserver, optcmd_steptrace;
 
 static struct optcmd_cmd *cmds[] = {
 	&optcmd_getscom, &optcmd_putscom, &optcmd_getcfam, &optcmd_putcfam,
@@ -103,7 +121,7 @@ static struct optcmd_cmd *cmds[] = {
 	&optcmd_threadstatus, &optcmd_sreset, &optcmd_regs, &optcmd_probe,
 	&optcmd_getmem, &optcmd_putmem, &optcmd_getmemio, &optcmd_putmemio,
 	&optcmd_getxer, &optcmd_putxer, &optcmd_getcr, &optcmd_putcr,
-	&optcmd_gdbserver,
+	&optcmd_gdbserver, &optcmd_steptrace,
 };
 
 /* Purely for printing usage text. We could integrate printing argument and flag
@@ -131,6 +149,7 @@ static struct action actions[] = {
 	{ "start",   "", "Start thread" },
 	{ "step",    "<count>", "Set a thread <count> instructions" },
 	{ "stop",    "", "Stop thread" },
+	{ "steptrace", "<count> [--regs]", "Step a thread <count> instructions recording the NIA (and GPRs) to a file" },
 	{ "htm", "core|nest start|stop|status|dump|record", "Hardware Trace Macro" },
 	{ "probe", "", "" },
 	{ "getcfam", "<address>", "Read system cfam" },
@@ -145,6 +164,8 @@ static struct action actions[] = {
 	{ "sreset",  "", "Reset" },
 	{ "regs",  "[--backtrace]", "State (optionally display backtrace)" },
 	{ "gdbserver", "", "Start a gdb server" },
+	{ "shell", "", "Read commands from stdin and run them after probing once" },
+	{ "daemon", "[<socket>]", "Serve requests for the selected targets on a Unix socket" },
 };
 
 static void print_usage(void)
@@ -178,6 +199,18 @@ static void print_usage(void)
 	printf("\t\tand defaults to 0x50 for I2C\n");
 	printf("\t-D, --debug=<debug level>\n");
 	printf("\t\t0:error (default) 1:warning 2:notice 3:info 4:debug\n");
+	printf("\t-j, --parallel-probe\n");
+	printf("\t\tProbe targets behind different FSI links and PIBs in parallel\n");
+	printf("\t-C, --probe-cache=<file>\n");
+	printf("\t\tSkip probing targets already known to be missing or present\n");
+	printf("\t\tfrom previous runs using the same file\n");
+	printf("\t-f, --script=<file>\n");
+	printf("\t\tRun the commands in a file, one per line, after probing once\n");
+	printf("\t--stats\n");
+	printf("\t\tPrint the number and latency of hardware operations at exit\n");
+	printf("\t--trace=<file>\n");
+	printf("\t\tWrite a timeline of hardware operations to a file at exit in\n");
+	printf("\t\tthe Chrome trace event format\n");
 	printf("\t-S, --shutup\n");
 	printf("\t\tShut up those annoying progress bars\n");
 	printf("\t-V, --version\n");
@@ -316,6 +349,9 @@ static bool parse_options(int argc, char *argv[])
 		{"chip",		required_argument,	NULL,	'c'},
 		{"device",		required_argument,	NULL,	'd'},
 		{"help",		no_argument,		NULL,	'h'},
+		{"script",		required_argument,	NULL,	'f'},
+		{"parallel-probe",	no_argument,		NULL,	'j'},
+		{"probe-cache",		required_argument,	NULL,	'C'},
 		{"processor",		required_argument,	NULL,	'p'},
 		{"slave-address",	required_argument,	NULL,	's'},
 		{"thread",		required_argument,	NULL,	't'},
@@ -325,6 +361,8 @@ static bool parse_options(int argc, char *argv[])
 		{"debug",		required_argument,	NULL,	'D'},
 		{"path",		required_argument,	NULL,	'P'},
 		{"shutup",		no_argument,		NULL,	'S'},
+		{"stats",		no_argument,		NULL,	OPT_STATS},
+		{"trace",		required_argument,	NULL,	OPT_TRACE},
 		{"version",		no_argument,		NULL,	'V'},
 		{NULL,			0,			NULL,     0}
 	};
@@ -337,7 +375,7 @@ static bool parse_options(int argc, char *argv[])
 	memset(l_list, 0, sizeof(l_list));
 
 	do {
-		c = getopt_long(argc, argv, "+ab:c:d:hp:s:t:D:P:SV" PPC_OPTS,
+		c = getopt_long(argc, argv, "+ab:c:C:d:f:hjp:s:t:D:P:SV" PPC_OPTS,
 				long_opts, NULL);
 		if (c == -1)
 			break;
@@ -432,10 +470,30 @@ static bool parse_options(int argc, char *argv[])
 			progress_shutup();
 			break;
 
+		case 'j':
+			pdbg_set_parallel_probe(true);
+			break;
+
+		case 'C':
+			probe_cache = optarg;
+			break;
+
+		case 'f':
+			script = optarg;
+			break;
+
 		case 'D':
 			pdbg_set_loglevel(atoi(optarg));
 			break;
 
+		case OPT_STATS:
+			stats = true;
+			break;
+
+		case OPT_TRACE:
+			trace_file = optarg;
+			break;
+
 		case 'V':
 			printf("%s (commit %s)\n", PACKAGE_STRING, GIT_SHA1);
 			exit(0);
@@ -528,6 +586,9 @@ static bool parse_options(int argc, char *argv[])
 
 static bool target_selection(void)
 {
+	/* Only the selected targets and their parents are usually needed */
+	pdbg_set_lazy_expand(true);
+
 	switch (backend) {
 #ifdef TARGET_ARM
 	case I2C:
@@ -602,6 +663,14 @@ static bool target_selection(void)
 		return false;
 	}
 
+	if (probe_cache) {
+		char key[64];
+
+		snprintf(key, sizeof(key), "%s:%s", backend_names[backend],
+			 device_node ? device_node : "");
+		pdbg_probe_cache_load(probe_cache, key);
+	}
+
 	if (pathsel_count) {
 		if (!path_target_parse(pathsel, pathsel_count))
 			return false;
@@ -657,6 +726,11 @@ static int probe(void)
 }
 OPTCMD_DEFINE_CMD(probe, probe);
 
+static void atexit_trace(void)
+{
+	pdbg_trace_write(trace_file);
+}
+
 /*
  * Release handler.
  */
@@ -665,12 +739,109 @@ static void atexit_release(void)
 	pdbg_target_release(pdbg_target_root());
 }
 
-int main(int argc, char *argv[])
+/*
+ * Runs a single command where argv[0] is the command name. Returns the
+ * command's result which is greater than zero on success.
+ */
+static int run_command(int argc, char *argv[])
 {
-	int i, rc = 0;
 	void **args, **flags;
 	optcmd_cmd_t *cmd;
-	struct pdbg_target *target;
+	int i, rc;
+
+	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if (!strcmp(argv[0], cmds[i]->cmd)) {
+			/* Found our command */
+			cmd = optcmd_parse(cmds[i], (const char **) &argv[1],
+					   argc - 1, &args, &flags);
+			if (!cmd)
+				return -1;
+
+			rc = cmd(args, flags);
+			optcmd_free(cmds[i], args, flags);
+			return rc;
+		}
+	}
+
+	/* Process subcommands. Currently only 'htm'.
+	 * TODO: Move htm command parsing to optcmd once htm clean-up is complete */
+	if (!strcmp(argv[0], "htm"))
+		return run_htm(0, argc, argv);
+
+	PR_ERROR("Unsupported command: %s\n", argv[0]);
+	return -1;
+}
+
+/*
+ * Runs commands read a line at a time against the targets probed at
+ * startup. Blank lines and anything after a '#' are ignored. The time each
+ * command takes is reported on stderr. Returns the number of commands which
+ * failed.
+ */
+static int run_session(FILE *file, bool interactive)
+{
+	char *line = NULL, *tok, *saveptr, **argv = NULL;
+	struct timespec start, end;
+	int argc, max_args = 0, failed = 0, rc;
+	size_t len = 0;
+	double ms;
+
+	for (;;) {
+		if (interactive) {
+			printf("pdbg> ");
+			fflush(stdout);
+		}
+
+		if (getline(&line, &len, file) < 0)
+			break;
+
+		argc = 0;
+		saveptr = NULL;
+		for (tok = strtok_r(line, " \t\n", &saveptr); tok && *tok != '#';
+		     tok = strtok_r(NULL, " \t\n", &saveptr)) {
+			if (argc == max_args) {
+				max_args = max_args ? max_args * 2 : 8;
+				argv = realloc(argv, max_args * sizeof(*argv));
+				assert(argv);
+			}
+			argv[argc++] = tok;
+		}
+
+		if (!argc)
+			continue;
+
+		if (!strcmp(argv[0], "exit") || !strcmp(argv[0], "quit"))
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		rc = run_command(argc, argv);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+			(end.tv_nsec - start.tv_nsec) / 1000000.0;
+		fflush(stdout);
+		fprintf(stderr, "%s: %.3f ms%s\n", argv[0], ms,
+			rc > 0 ? "" : " (failed)");
+
+		if (rc <= 0)
+			failed++;
+	}
+
+	free(argv);
+	free(line);
+
+	if (interactive)
+		printf("\n");
+
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	int rc = 0, ntargets = 0;
+	struct pdbg_target *target, **targets = NULL;
+	bool shell = false, daemon = false;
+	FILE *file = NULL;
 
 	backend = default_backend();
 
@@ -680,9 +851,36 @@ int main(int argc, char *argv[])
 	if (!parse_options(argc, argv))
 		return 1;
 
-	if (optind >= argc) {
+	if (script) {
+		if (optind < argc) {
+			fprintf(stderr, "Can't mix -f with a command\n");
+			return 1;
+		}
+
+		file = fopen(script, "r");
+		if (!file) {
+			fprintf(stderr, "Unable to open %s: %m\n", script);
+			return 1;
+		}
+	} else if (optind >= argc) {
 		print_usage();
 		return 1;
+	} else if (!strcmp(argv[optind], "shell")) {
+		shell = true;
+	} else if (!strcmp(argv[optind], "daemon")) {
+		daemon = true;
+	}
+
+	/* Registered first so the operations done while releasing targets at
+	 * exit are included */
+	if (stats) {
+		pdbg_stats_enable(true);
+		atexit(stats_print);
+	}
+
+	if (trace_file) {
+		pdbg_trace_enable(true);
+		atexit(atexit_trace);
 	}
 
 	/* Disable unselected targets */
@@ -691,37 +889,32 @@ int main(int argc, char *argv[])
 
 	/* Probe all selected targets */
 	for_each_path_target(target) {
-		pdbg_target_probe(target);
+		targets = realloc(targets, (ntargets + 1) * sizeof(*targets));
+		assert(targets);
+		targets[ntargets++] = target;
 	}
+	pdbg_target_probe_list(targets, ntargets);
+	free(targets);
+
+	if (probe_cache)
+		pdbg_probe_cache_save();
 
 	atexit(atexit_release);
 
-	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
-		if (!strcmp(argv[optind], cmds[i]->cmd)) {
-			/* Found our command */
-			cmd = optcmd_parse(cmds[i], (const char **) &argv[optind + 1],
-					   argc - (optind + 1), &args, &flags);
-			if (cmd) {
-				rc = cmd(args, flags);
-				goto found_action;
-			} else {
-				/* Error parsing arguments so exit return directly */
-				return 1;
-			}
-		}
+	/* Every command in a session shares the targets probed above */
+	if (file) {
+		rc = run_session(file, false);
+		fclose(file);
+		return rc ? 1 : 0;
 	}
 
-	/* Process subcommands. Currently only 'htm'.
-	 * TODO: Move htm command parsing to optcmd once htm clean-up is complete */
-	if (!strcmp(argv[optind], "htm")) {
-		rc = run_htm(optind, argc, argv);
-		goto found_action;
-	}
+	if (shell)
+		return run_session(stdin, isatty(STDIN_FILENO)) ? 1 : 0;
 
-	PR_ERROR("Unsupported command: %s\n", argv[optind]);
-	return 1;
+	if (daemon)
+		return pdbgd_run(optind + 1 < argc ? argv[optind + 1] : PDBGD_SOCKET) ? 1 : 0;
 
-found_action:
+	rc = run_command(argc - optind, &argv[optind]);
 	if (rc > 0)
 		return 0;
 
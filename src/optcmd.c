@@ -108,3 +108,17 @@ optcmd_cmd_t *optcmd_parse(struct optcmd_cmd *cmd, const char *argv[], int argc,
 
 	return cmd->cmdp;
 }
+
+void optcmd_free(struct optcmd_cmd *cmd, void *args[], void *flags[])
+{
+	int i;
+
+	for (i = 0; cmd->args[i].parser && i < OPTCMD_MAX_ARGS; i++)
+		free(args[i]);
+
+	for (i = 0; cmd->flags[i].arg && i < OPTCMD_MAX_FLAGS; i++)
+		free(flags[i]);
+
+	free(args);
+	free(flags);
+}
@@ -204,4 +204,7 @@ struct optcmd_cmd {
 optcmd_cmd_t *optcmd_parse(struct optcmd_cmd *cmd, const char *argv[], int argc,
 			   void **args[], void **flags[]);
 
+/* Frees the results of a successful optcmd_parse() */
+void optcmd_free(struct optcmd_cmd *cmd, void *args[], void *flags[]);
+
 #endif
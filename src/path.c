@@ -20,180 +20,246 @@
 #include <ctype.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
+#include <fnmatch.h>
 
 #include <libpdbg.h>
 
+#include "hash.h"
 #include "path.h"
-#include "util.h"
 
-#define MAX_PATH_COMP_LEN	32
-#define MAX_PATH_COMPONENTS	16
-#define MAX_PATH_LEN		(MAX_PATH_COMP_LEN * MAX_PATH_COMPONENTS)
+/* A range of target indexes */
+struct path_range {
+	unsigned long from;
+	unsigned long to;
+};
 
-/* This is max(MAX_PROCESSORS, MAX_CHIPS, MAX_THREADS) */
-#define MAX_PATH_INDEX		64
+/*
+ * One component of a compiled path pattern. A component matches a target if
+ * the target's class matches the name, which may be a glob, and its index
+ * is in one of the ranges (or none of them if negated). Components with an
+ * '@' are instead matched against the target's node name.
+ */
+struct path_comp {
+	char *name;
+	int class_id;
+	bool any;
+	bool node_name;
+	bool negate;
+	struct path_range *ranges;
+	int range_count;
+};
 
 struct path_pattern {
-	char prefix[MAX_PATH_COMP_LEN];
-	int index[MAX_PATH_INDEX];
-	bool match_full;
-	bool match_index;
+	struct path_comp *comps;
+	int count;
 };
 
-/* Start with max threads, rather than defining arbitrary number */
-#define MAX_TARGETS	(64 * 24 * 8)
-
-static struct pdbg_target *path_target[MAX_TARGETS];
+/*
+ * The selected targets in the order they were selected. Each one is also
+ * indexed by its position so that finding where a target is in the
+ * selection doesn't need a scan.
+ */
+static struct pdbg_target **path_target;
 static unsigned int path_target_count;
+static unsigned int path_target_size;
 
-static void safe_strcpy(char *dest, size_t n, const char *src)
+static bool path_target_equal(const void *a, const void *b)
 {
-	assert(strlen(src) + 1 <= n);
+	return a == b;
+}
+
+static struct hash_table path_target_index = HASH_TABLE_INIT(path_target_equal);
 
-	strcpy(dest, src);
+static bool path_glob(const char *str)
+{
+	return strpbrk(str, "*?") != NULL;
+}
+
+/* Parses a list of indexes and ranges such as "1-3,11-13" */
+static bool path_range_parse(const char *arg, struct path_comp *comp)
+{
+	const char *p = arg;
+	unsigned long from, to;
+	char *end;
+
+	while (*p) {
+		if (*p == ',') {
+			p++;
+			continue;
+		}
+
+		from = strtoul(p, &end, 0);
+		if (end == p)
+			return false;
+
+		to = from;
+		if (*end == '-') {
+			p = end + 1;
+			to = strtoul(p, &end, 0);
+			if (end == p || to < from)
+				return false;
+		}
+
+		if (*end && *end != ',')
+			return false;
+		p = end;
+
+		comp->ranges = realloc(comp->ranges,
+				       (comp->range_count + 1) * sizeof(*comp->ranges));
+		assert(comp->ranges);
+		comp->ranges[comp->range_count].from = from;
+		comp->ranges[comp->range_count].to = to;
+		comp->range_count++;
+	}
+
+	return true;
 }
 
 /*
  * Parse string components of following forms:
  *	pib0
  *	core[1-3,11-13]
+ *	core[!0]
  *	thread*
+ *	*htm
+ *	*
  *	adu@123000
  */
-static bool path_pattern_parse(const char *arg, struct path_pattern *pat)
+static bool path_comp_parse(const char *arg, struct path_comp *comp)
 {
-	char tmp[strlen(arg)+1];
-	char *tok;
-	bool ok;
+	char *name, *open, *close;
+	size_t n;
 
-	safe_strcpy(tmp, sizeof(tmp), arg);
+	memset(comp, 0, sizeof(*comp));
+	comp->class_id = -1;
 
-	memset(pat, 0, sizeof(*pat));
+	name = strdup(arg);
+	assert(name);
+	comp->name = name;
 
-	if (strchr(tmp, '@')) {
-		safe_strcpy(pat->prefix, sizeof(pat->prefix), tmp);
-		pat->match_full = true;
+	if (!strcmp(name, "*")) {
+		comp->any = true;
+		return true;
+	}
 
-	} else if (strchr(tmp, '*')) {
-		tok = strtok(tmp, "*");
-		if (!tok)
-			safe_strcpy(pat->prefix, sizeof(pat->prefix), "all");
-		else
-			safe_strcpy(pat->prefix, sizeof(pat->prefix), tok);
+	if (strchr(name, '@')) {
+		comp->node_name = true;
+		return true;
+	}
 
-	} else if (strchr(tmp, '[')) {
-		tok = strtok(tmp, "[");
-		if (tok == NULL) {
+	open = strchr(name, '[');
+	if (open) {
+		close = strchr(open, ']');
+		if (open == name || !close || close[1]) {
 			fprintf(stderr, "Invalid pattern '%s'\n", arg);
 			return false;
 		}
-		safe_strcpy(pat->prefix, sizeof(pat->prefix), tok);
 
-		tok = strtok(NULL, "]");
-		if (!tok) {
-			fprintf(stderr, "Invalid pattern '%s'\n", arg);
-			return false;
+		*open++ = '\0';
+		*close = '\0';
+		if (*open == '!' || *open == '^') {
+			comp->negate = true;
+			open++;
 		}
 
-		ok = parse_list(tok, MAX_PATH_INDEX, pat->index, NULL);
-		if (!ok)
+		if (!path_range_parse(open, comp)) {
+			fprintf(stderr, "Invalid index list '%s'\n", arg);
 			return false;
-
-		pat->match_index = true;
-
+		}
 	} else {
-		size_t n = strlen(tmp) - 1;
-		while (n >= 0 && isdigit(tmp[n]))
+		/* A trailing number selects a single index */
+		n = strlen(name);
+		while (n > 0 && isdigit(name[n - 1]))
 			n--;
-		n++;
-
-		if (n != strlen(tmp)) {
-			int index;
 
-			index = atoi(&tmp[n]);
-			if (index < 0 || index >= MAX_PATH_INDEX) {
-				fprintf(stderr, "Invalid index '%s'\n", &tmp[n]);
+		if (n > 0 && name[n]) {
+			if (!path_range_parse(&name[n], comp)) {
+				fprintf(stderr, "Invalid index '%s'\n", &name[n]);
 				return false;
 			}
-			tmp[n] = '\0';
-			pat->index[index] = 1;
-			pat->match_index = true;
+			name[n] = '\0';
 		}
-
-		safe_strcpy(pat->prefix, sizeof(pat->prefix), tmp);
 	}
 
-	if (!pat->prefix)
-		return false;
+	/* Exact class names are compared by ID */
+	if (!path_glob(name))
+		comp->class_id = pdbg_class_id(name);
 
 	return true;
 }
 
-static int path_pattern_split(const char *arg, struct path_pattern *pats)
+static void path_pattern_free(struct path_pattern *pat)
 {
-	char arg_copy[MAX_PATH_LEN];
-	char *tmp, *tok, *saveptr = NULL;
-	int n;
-	bool ok;
+	int i;
+
+	for (i = 0; i < pat->count; i++) {
+		free(pat->comps[i].name);
+		free(pat->comps[i].ranges);
+	}
+	free(pat->comps);
+}
 
-	safe_strcpy(arg_copy, sizeof(arg_copy), arg);
+/* Compiles a pattern once so matching doesn't need to parse it again */
+static bool path_pattern_compile(const char *arg, struct path_pattern *pat)
+{
+	char *copy, *tok, *saveptr = NULL;
+	bool ok = true;
 
-	tmp = arg_copy;
-	n = 0;
-	while ((tok = strtok_r(tmp, "/", &saveptr))) {
-		size_t len = strlen(tok);
+	memset(pat, 0, sizeof(*pat));
 
-		if (len == 0)
-			continue;
+	copy = strdup(arg);
+	assert(copy);
 
-		if (len >= MAX_PATH_LEN) {
-			fprintf(stderr, "Pattern component '%s' too long\n", tok);
-			return -1;
-		}
+	for (tok = strtok_r(copy, "/", &saveptr); tok;
+	     tok = strtok_r(NULL, "/", &saveptr)) {
+		pat->comps = realloc(pat->comps, (pat->count + 1) * sizeof(*pat->comps));
+		assert(pat->comps);
 
-		ok = path_pattern_parse(tok, &pats[n]);
+		ok = path_comp_parse(tok, &pat->comps[pat->count]);
+		pat->count++;
 		if (!ok)
-			return -1;
+			break;
+	}
 
-		n++;
-		assert(n <= MAX_PATH_COMPONENTS);
+	free(copy);
 
-		tmp = NULL;
+	if (!ok || !pat->count) {
+		path_pattern_free(pat);
+		return false;
 	}
 
-	return n;
+	return true;
 }
 
 static int path_target_find(struct pdbg_target *prev)
 {
-	int i;
+	uintptr_t pos;
 
 	if (!prev)
 		return -1;
 
-	for (i=0; i<path_target_count; i++) {
-		if (path_target[i] == prev)
-			return i;
-	}
+	/* Positions are stored off by one so that NULL means not found */
+	pos = (uintptr_t) hash_find(&path_target_index, hash_pointer(prev, 0), prev);
 
-	return -1;
+	return (int) pos - 1;
 }
 
 struct pdbg_target *path_target_find_next(const char *klass, int index)
 {
 	struct pdbg_target *target;
-	int i;
+	int i, class_id = -1;
+
+	/* The class is looked up once rather than compared by name for every
+	 * target skipped. No target has an ID of -1 so an unknown class
+	 * matches nothing. */
+	if (klass)
+		class_id = pdbg_class_id(klass);
 
 	for (i=index+1; i<path_target_count; i++) {
 		target = path_target[i];
-		if (klass) {
-			const char *classname = pdbg_target_class_name(target);
-
-			if (!strcmp(klass, classname))
-				return target;
-		} else {
+		if (!klass || pdbg_target_class_id(target) == class_id)
 			return target;
-		}
 	}
 
 	return NULL;
@@ -201,90 +267,114 @@ struct pdbg_target *path_target_find_next(const char *klass, int index)
 
 bool path_target_add(struct pdbg_target *target)
 {
+	struct pdbg_target **targets;
+	unsigned int size;
 	int index;
 
 	index = path_target_find(target);
 	if (index >= 0)
 		return true;
 
-	if (path_target_count == MAX_TARGETS)
-		return false;
+	if (path_target_count == path_target_size) {
+		size = path_target_size ? path_target_size * 2 : 64;
+		targets = realloc(path_target, size * sizeof(*targets));
+		if (!targets)
+			return false;
+
+		path_target = targets;
+		path_target_size = size;
+	}
 
 	path_target[path_target_count] = target;
 	path_target_count++;
+	hash_insert(&path_target_index, hash_pointer(target, 0), target,
+		    (void *) (uintptr_t) path_target_count);
 	return true;
 }
 
-static void path_pattern_match(struct pdbg_target *target,
-			       struct path_pattern *pats,
-			       int max_levels,
-			       int level)
+static bool path_comp_match(struct path_comp *comp, struct pdbg_target *target)
 {
-	struct pdbg_target *child;
-	char comp_name[MAX_PATH_COMP_LEN];
 	const char *classname;
-	char *tok;
-	int next = level;
-	bool found = false;
-
-	if (target == pdbg_target_root()) {
-		goto end;
-	}
-
-	if (!strcmp("all", pats[level].prefix)) {
-		if (!path_target_add(target))
-			return;
-		goto end;
-	}
+	unsigned long index;
+	bool in_range;
+	int i;
 
-	classname = pdbg_target_class_name(target);
-	if (!classname)
-		goto end;
+	if (comp->node_name)
+		return !fnmatch(comp->name, pdbg_target_dn_name(target), 0);
 
-	safe_strcpy(comp_name, sizeof(comp_name), classname);
-	if (pats[level].match_full) {
-		tok = comp_name;
+	if (comp->class_id >= 0) {
+		if (pdbg_target_class_id(target) != comp->class_id)
+			return false;
 	} else {
-		tok = strtok(comp_name, "@");
+		classname = pdbg_target_class_name(target);
+		if (!classname || fnmatch(comp->name, classname, 0))
+			return false;
 	}
 
-	if (!strcmp(tok, pats[level].prefix)) {
-		found = true;
-
-		if (pats[level].match_index) {
-			int index = pdbg_target_index(target);
+	if (!comp->range_count)
+		return true;
 
-			if (pats[level].index[index] != 1)
-				found = false;
+	index = pdbg_target_index(target);
+	in_range = false;
+	for (i = 0; i < comp->range_count; i++) {
+		if (index >= comp->ranges[i].from && index <= comp->ranges[i].to) {
+			in_range = true;
+			break;
 		}
 	}
 
-	if (found) {
-		if (level == max_levels-1) {
+	return in_range != comp->negate;
+}
+
+/*
+ * Components don't have to match consecutive levels of the tree. A target
+ * which matches the current component moves matching of its descendants on
+ * to the next component, and a target which matches the last component is
+ * selected. A lone '*' selects the target and everything below it.
+ */
+static void path_pattern_match(struct pdbg_target *target,
+			       struct path_pattern *pat,
+			       int level)
+{
+	struct pdbg_target *child;
+	struct path_comp *comp;
+
+	if (target != pdbg_target_root() && pat->comps[level].any) {
+		path_target_add(target);
+	} else if (target != pdbg_target_root() &&
+		   path_comp_match(&pat->comps[level], target)) {
+		if (level == pat->count - 1) {
 			path_target_add(target);
 			return;
-		} else {
-			next = level + 1;
 		}
+
+		level++;
 	}
 
-end:
+	/* Nothing below can be selected unless something below matches the
+	 * current component, so don't walk (or create) targets which can't
+	 * be selected */
+	comp = &pat->comps[level];
+	if (!comp->any && !comp->node_name && !path_glob(comp->name) &&
+	    !pdbg_target_contains_class(target, comp->name))
+		return;
+
 	pdbg_for_each_child_target(target, child) {
-		path_pattern_match(child, pats, max_levels, next);
+		path_pattern_match(child, pat, level);
 	}
 }
 
 bool path_target_parse(const char **arg, int arg_count)
 {
-	struct path_pattern pats[MAX_PATH_COMPONENTS];
-	int i, n;
+	struct path_pattern pat;
+	int i;
 
 	for (i=0; i<arg_count; i++) {
-		n = path_pattern_split(arg[i], pats);
-		if (n <= 0)
+		if (!path_pattern_compile(arg[i], &pat))
 			return false;
 
-		path_pattern_match(pdbg_target_root(), pats, n, 0);
+		path_pattern_match(pdbg_target_root(), &pat, 0);
+		path_pattern_free(&pat);
 	}
 
 	return true;
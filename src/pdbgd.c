@@ -0,0 +1,471 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Long running daemon which keeps the selected targets probed and serves
+ * requests for them over a Unix domain socket, see pdbgd.h for the protocol.
+ * Each client is served by its own thread. Requests for targets on the same
+ * bus (the FSI link, or PIB if there isn't one) are serialised while those
+ * for different buses run concurrently.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/un.h>
+
+#include <libpdbg.h>
+#include <target.h>
+
+#include "debug.h"
+#include "path.h"
+#include "pdbgd.h"
+
+struct pdbgd_bus {
+	struct pdbg_target *target;
+	pthread_mutex_t lock;
+};
+
+static struct pdbg_target **pdbgd_targets;
+static int *pdbgd_target_bus;
+static uint32_t pdbgd_target_count;
+
+static struct pdbgd_bus *pdbgd_buses;
+static int pdbgd_bus_count;
+
+/* Returns the outermost FSI above target, or the PIB if there isn't one */
+static struct pdbg_target *pdbgd_bus_target(struct pdbg_target *target)
+{
+	struct pdbg_target *bus = NULL, *parent;
+	int fsi = pdbg_class_id("fsi");
+
+	for (parent = target; parent; parent = pdbg_target_parent(NULL, parent))
+		if (pdbg_target_class_id(parent) == fsi)
+			bus = parent;
+
+	if (!bus && pdbg_target_is_class(target, "pib"))
+		bus = target;
+
+	if (!bus)
+		bus = pdbg_target_parent("pib", target);
+
+	return bus;
+}
+
+static void pdbgd_add_target(struct pdbg_target *target)
+{
+	struct pdbg_target *bus = pdbgd_bus_target(target);
+	int i;
+
+	for (i = 0; i < pdbgd_bus_count; i++)
+		if (pdbgd_buses[i].target == bus)
+			break;
+
+	if (i == pdbgd_bus_count) {
+		pdbgd_buses = realloc(pdbgd_buses, (i + 1) * sizeof(*pdbgd_buses));
+		assert(pdbgd_buses);
+		pdbgd_buses[i].target = bus;
+		pthread_mutex_init(&pdbgd_buses[i].lock, NULL);
+		pdbgd_bus_count++;
+	}
+
+	pdbgd_targets = realloc(pdbgd_targets,
+				(pdbgd_target_count + 1) * sizeof(*pdbgd_targets));
+	assert(pdbgd_targets);
+	pdbgd_target_bus = realloc(pdbgd_target_bus,
+				   (pdbgd_target_count + 1) * sizeof(*pdbgd_target_bus));
+	assert(pdbgd_target_bus);
+
+	pdbgd_targets[pdbgd_target_count] = target;
+	pdbgd_target_bus[pdbgd_target_count] = i;
+	pdbgd_target_count++;
+}
+
+/* Finds the target of the given class at, above or below the target */
+static struct pdbg_target *pdbgd_class_target(struct pdbg_target *target, const char *klass)
+{
+	struct pdbg_target *found;
+
+	if (pdbg_target_is_class(target, klass))
+		found = target;
+	else
+		found = pdbg_target_parent(klass, target);
+
+	if (!found) {
+		pdbg_for_each_target(klass, target, found) {
+			if (pdbg_target_probe(found) == PDBG_TARGET_ENABLED)
+				break;
+		}
+	}
+
+	if (!found || pdbg_target_probe(found) != PDBG_TARGET_ENABLED)
+		return NULL;
+
+	return found;
+}
+
+static int pdbgd_targets_payload(uint8_t **out, uint32_t *len)
+{
+	char *path, *buf = NULL;
+	size_t size = 0, n;
+	uint32_t i;
+
+	for (i = 0; i < pdbgd_target_count; i++) {
+		path = pdbg_target_path(pdbgd_targets[i]);
+		if (!path)
+			return -ENOMEM;
+
+		n = strlen(path) + 1;
+		buf = realloc(buf, size + n);
+		assert(buf);
+		memcpy(buf + size, path, n);
+		size += n;
+		free(path);
+	}
+
+	if (size > PDBGD_MAX_PAYLOAD) {
+		free(buf);
+		return -E2BIG;
+	}
+
+	*out = (uint8_t *) buf;
+	*len = size;
+	return 0;
+}
+
+static int pdbgd_thread_status(struct pdbg_target *thread, uint64_t *data)
+{
+	struct pdbg_target *core = pdbg_target_parent("core", thread);
+	struct thread_state status;
+
+	/* Clients poll for changes so the status must not be stale */
+	if (core)
+		thread_status_refresh(core);
+
+	status = thread_status(thread);
+
+	*data = (status.active ? PDBGD_STATUS_ACTIVE : 0) |
+		(status.quiesced ? PDBGD_STATUS_QUIESCED : 0) |
+		((uint64_t) status.sleep_state << 8) |
+		((uint64_t) status.smt_state << 16);
+
+	return 0;
+}
+
+/* Runs a request with the lock for the target's bus held */
+static int pdbgd_op(struct pdbgd_request *req, uint8_t *in,
+		    struct pdbgd_response *resp, uint8_t **out)
+{
+	struct pdbg_target *target = pdbgd_targets[req->target];
+	struct pdbg_target *pib, *fsi, *adu, *thread;
+	uint32_t val32;
+	uint64_t val;
+
+	switch (req->op) {
+	case PDBGD_OP_GETSCOM:
+	case PDBGD_OP_PUTSCOM:
+		pib = pdbgd_class_target(target, "pib");
+		if (!pib)
+			return -ENODEV;
+
+		if (req->op == PDBGD_OP_PUTSCOM)
+			return pib_write(pib, req->addr, req->data) ? -EIO : 0;
+
+		return pib_read(pib, req->addr, &resp->data) ? -EIO : 0;
+
+	case PDBGD_OP_GETCFAM:
+	case PDBGD_OP_PUTCFAM:
+		fsi = pdbgd_class_target(target, "fsi");
+		if (!fsi)
+			return -ENODEV;
+
+		if (req->op == PDBGD_OP_PUTCFAM)
+			return fsi_write(fsi, req->addr, req->data) ? -EIO : 0;
+
+		if (fsi_read(fsi, req->addr, &val32))
+			return -EIO;
+		resp->data = val32;
+		return 0;
+
+	case PDBGD_OP_GETMEM:
+	case PDBGD_OP_PUTMEM:
+		adu = pdbgd_class_target(target, "adu");
+		if (!adu)
+			return -ENODEV;
+
+		if (req->op == PDBGD_OP_PUTMEM)
+			return adu_putmem(adu, req->addr, in, req->len) ? -EIO : 0;
+
+		if (req->data > PDBGD_MAX_PAYLOAD)
+			return -E2BIG;
+
+		*out = malloc(req->data ? req->data : 1);
+		if (!*out)
+			return -ENOMEM;
+
+		if (adu_getmem(adu, req->addr, *out, req->data))
+			return -EIO;
+		resp->len = req->data;
+		return 0;
+
+	default:
+		break;
+	}
+
+	/* Everything else operates on a thread */
+	thread = pdbgd_class_target(target, "thread");
+	if (!thread)
+		return -ENODEV;
+
+	switch (req->op) {
+	case PDBGD_OP_GETGPR:
+		return ram_getgpr(thread, req->addr, &resp->data) ? -EIO : 0;
+	case PDBGD_OP_PUTGPR:
+		return ram_putgpr(thread, req->addr, req->data) ? -EIO : 0;
+	case PDBGD_OP_GETSPR:
+		return ram_getspr(thread, req->addr, &resp->data) ? -EIO : 0;
+	case PDBGD_OP_PUTSPR:
+		return ram_putspr(thread, req->addr, req->data) ? -EIO : 0;
+	case PDBGD_OP_GETNIA:
+		return ram_getnia(thread, &resp->data) ? -EIO : 0;
+	case PDBGD_OP_PUTNIA:
+		return ram_putnia(thread, req->data) ? -EIO : 0;
+	case PDBGD_OP_GETMSR:
+		return ram_getmsr(thread, &resp->data) ? -EIO : 0;
+	case PDBGD_OP_PUTMSR:
+		return ram_putmsr(thread, req->data) ? -EIO : 0;
+	case PDBGD_OP_START:
+		return ram_start_thread(thread) ? -EIO : 0;
+	case PDBGD_OP_STOP:
+		return ram_stop_thread(thread) ? -EIO : 0;
+	case PDBGD_OP_STEP:
+		return ram_step_thread(thread, req->data) ? -EIO : 0;
+	case PDBGD_OP_SRESET:
+		return ram_sreset_thread(thread) ? -EIO : 0;
+	case PDBGD_OP_THREADSTATUS:
+		val = 0;
+		pdbgd_thread_status(thread, &val);
+		resp->data = val;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int pdbgd_request(struct pdbgd_request *req, uint8_t *in,
+			 struct pdbgd_response *resp, uint8_t **out)
+{
+	struct pdbgd_bus *bus;
+	int rc;
+
+	if (req->op == PDBGD_OP_TARGETS)
+		return pdbgd_targets_payload(out, &resp->len);
+
+	if (req->op < PDBGD_OP_GETSCOM || req->op > PDBGD_OP_THREADSTATUS)
+		return -EINVAL;
+
+	if (req->target >= pdbgd_target_count)
+		return -ENODEV;
+
+	bus = &pdbgd_buses[pdbgd_target_bus[req->target]];
+	pthread_mutex_lock(&bus->lock);
+	rc = pdbgd_op(req, in, resp, out);
+	pthread_mutex_unlock(&bus->lock);
+
+	return rc;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		buf = (uint8_t *) buf + n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		buf = (const uint8_t *) buf + n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void *pdbgd_client(void *arg)
+{
+	int fd = (intptr_t) arg;
+	struct pdbgd_request req;
+	struct pdbgd_response resp;
+	uint8_t *in, *out;
+
+	while (!read_full(fd, &req, sizeof(req))) {
+		if (req.len > PDBGD_MAX_PAYLOAD)
+			break;
+
+		in = malloc(req.len ? req.len : 1);
+		if (!in || read_full(fd, in, req.len)) {
+			free(in);
+			break;
+		}
+
+		memset(&resp, 0, sizeof(resp));
+		out = NULL;
+		resp.rc = pdbgd_request(&req, in, &resp, &out);
+		if (resp.rc)
+			resp.len = 0;
+
+		if (write_full(fd, &resp, sizeof(resp)) ||
+		    write_full(fd, out, resp.len)) {
+			free(in);
+			free(out);
+			break;
+		}
+
+		free(in);
+		free(out);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+int pdbgd_run(const char *path)
+{
+	struct sockaddr_un addr;
+	struct pollfd fds[2];
+	struct pdbg_target *target;
+	pthread_attr_t attr;
+	pthread_t tid;
+	sigset_t mask;
+	int fd, sfd, client, i;
+
+	for_each_path_target(target) {
+		if (pdbg_target_probe(target) == PDBG_TARGET_ENABLED)
+			pdbgd_add_target(target);
+	}
+
+	if (!pdbgd_target_count) {
+		fprintf(stderr, "No targets selected\n");
+		return -1;
+	}
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path %s is too long\n", path);
+		return -1;
+	}
+
+	/* Signals are handled in this thread so that shutdown can wait for
+	 * requests in progress */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, 0);
+	if (sfd < 0) {
+		PR_ERROR("Unable to create signalfd: %m\n");
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		PR_ERROR("Unable to create socket: %m\n");
+		close(sfd);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 16)) {
+		PR_ERROR("Unable to listen on %s: %m\n", path);
+		close(fd);
+		close(sfd);
+		return -1;
+	}
+
+	printf("Serving %d targets on %s\n", pdbgd_target_count, path);
+	fflush(stdout);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = sfd;
+	fds[1].events = POLLIN;
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		if (!(fds[0].revents & POLLIN))
+			continue;
+
+		client = accept(fd, NULL, NULL);
+		if (client < 0)
+			continue;
+
+		if (pthread_create(&tid, &attr, pdbgd_client, (void *) (intptr_t) client))
+			close(client);
+	}
+
+	pthread_attr_destroy(&attr);
+	close(fd);
+	close(sfd);
+	unlink(path);
+
+	/* Wait for requests in progress and stop any more from starting
+	 * before the targets are released */
+	for (i = 0; i < pdbgd_bus_count; i++)
+		pthread_mutex_lock(&pdbgd_buses[i].lock);
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __PDBGD_H
+#define __PDBGD_H
+
+#include <stdint.h>
+
+/*
+ * Protocol spoken over the pdbg daemon's Unix domain socket. Clients send a
+ * request header followed by len bytes of payload and get back a response
+ * header followed by len bytes of payload. Requests on one connection are
+ * handled in order. All fields are in host byte order.
+ *
+ * Targets are identified by their position in the daemon's selection. The
+ * PDBGD_OP_TARGETS request returns the path of every target as a NUL
+ * terminated string in that order.
+ *
+ * Requests may be sent to any target with a parent or child of the class
+ * an operation needs. For example a SCOM may be sent to a thread and will go
+ * to the PIB above it.
+ */
+#define PDBGD_SOCKET		"/run/pdbgd.sock"
+#define PDBGD_MAX_PAYLOAD	(1024 * 1024)
+
+enum pdbgd_op {
+	PDBGD_OP_TARGETS = 1,
+	PDBGD_OP_GETSCOM,	/* addr -> data */
+	PDBGD_OP_PUTSCOM,	/* addr, data */
+	PDBGD_OP_GETCFAM,	/* addr -> data */
+	PDBGD_OP_PUTCFAM,	/* addr, data */
+	PDBGD_OP_GETMEM,	/* addr, data = size -> payload */
+	PDBGD_OP_PUTMEM,	/* addr, payload */
+	PDBGD_OP_GETGPR,	/* addr = gpr -> data */
+	PDBGD_OP_PUTGPR,	/* addr = gpr, data */
+	PDBGD_OP_GETSPR,	/* addr = spr -> data */
+	PDBGD_OP_PUTSPR,	/* addr = spr, data */
+	PDBGD_OP_GETNIA,	/* -> data */
+	PDBGD_OP_PUTNIA,	/* data */
+	PDBGD_OP_GETMSR,	/* -> data */
+	PDBGD_OP_PUTMSR,	/* data */
+	PDBGD_OP_START,
+	PDBGD_OP_STOP,
+	PDBGD_OP_STEP,		/* data = count */
+	PDBGD_OP_SRESET,
+	PDBGD_OP_THREADSTATUS,	/* -> data, see PDBGD_STATUS_* */
+};
+
+/* Layout of the data returned by PDBGD_OP_THREADSTATUS */
+#define PDBGD_STATUS_ACTIVE	0x1
+#define PDBGD_STATUS_QUIESCED	0x2
+#define PDBGD_STATUS_SLEEP(x)	(((x) >> 8) & 0xff)
+#define PDBGD_STATUS_SMT(x)	(((x) >> 16) & 0xff)
+
+struct pdbgd_request {
+	uint32_t op;
+	uint32_t target;
+	uint64_t addr;
+	uint64_t data;
+	uint32_t len;
+	uint32_t reserved;
+};
+
+/* rc is 0 on success or a negative errno */
+struct pdbgd_response {
+	int32_t rc;
+	uint32_t len;
+	uint64_t data;
+};
+
+/* Serves requests on the given socket path for the selected targets until
+ * interrupted. Returns 0 on a clean shutdown. */
+int pdbgd_run(const char *path);
+
+#endif
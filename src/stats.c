@@ -0,0 +1,89 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <libpdbg.h>
+
+#include "stats.h"
+
+static const char *format_ns(char *buf, size_t len, uint64_t ns)
+{
+	if (ns < 1000)
+		snprintf(buf, len, "%" PRIu64 "ns", ns);
+	else if (ns < 1000000)
+		snprintf(buf, len, "%.1fus", ns / 1000.0);
+	else if (ns < 1000000000)
+		snprintf(buf, len, "%.1fms", ns / 1000000.0);
+	else
+		snprintf(buf, len, "%.1fs", ns / 1000000000.0);
+
+	return buf;
+}
+
+static void stats_print_op(const char *name, enum pdbg_stat_op op,
+			   struct pdbg_stat *stat)
+{
+	char mean[16], max[16], from[16], to[16];
+	int i;
+
+	fprintf(stderr, "%s %s: %" PRIu64 " ops, %" PRIu64 " errors, mean %s, max %s\n",
+		name, pdbg_stat_name(op), stat->count, stat->errors,
+		format_ns(mean, sizeof(mean), stat->total_ns / stat->count),
+		format_ns(max, sizeof(max), stat->max_ns));
+
+	for (i = 0; i < PDBG_STAT_BUCKETS; i++) {
+		if (!stat->buckets[i])
+			continue;
+
+		format_ns(from, sizeof(from), pdbg_stat_bucket_ns(i));
+		if (i == PDBG_STAT_BUCKETS - 1)
+			fprintf(stderr, "\t>= %s: %" PRIu64 "\n", from, stat->buckets[i]);
+		else
+			fprintf(stderr, "\t%s - %s: %" PRIu64 "\n", from,
+				format_ns(to, sizeof(to), pdbg_stat_bucket_ns(i + 1)),
+				stat->buckets[i]);
+	}
+}
+
+static void stats_print_all(const char *name, struct pdbg_stat *stats)
+{
+	int op;
+
+	for (op = 0; op < PDBG_STAT_OP_COUNT; op++)
+		if (stats[op].count)
+			stats_print_op(name, op, &stats[op]);
+}
+
+void stats_print(void)
+{
+	struct pdbg_stat stats[PDBG_STAT_OP_COUNT];
+	struct pdbg_target *target = NULL;
+	char *path;
+
+	fflush(stdout);
+
+	while ((target = pdbg_stats_next_target(target))) {
+		pdbg_stats_get(target, stats, false);
+		path = pdbg_target_path(target);
+		stats_print_all(path ? path : "?", stats);
+		free(path);
+	}
+
+	pdbg_stats_get(NULL, stats, false);
+	stats_print_all("total", stats);
+}
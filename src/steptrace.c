@@ -0,0 +1,167 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Single step instruction tracer for when HTM isn't available. Each selected
+ * thread is stepped and its NIA (and optionally GPRs) recorded at every step
+ * into a file named steptrace-p<chip>-c<core>-t<thread>.dump.
+ *
+ * The file starts with the 8 byte magic "PDBGSTEP", a version byte and a
+ * flags byte (bit 0 set if GPRs are recorded). It is followed by one record
+ * per step, the first being the state before any step is taken. A record is
+ * the zigzag encoded difference from the previous NIA as an unsigned LEB128
+ * varint. If GPRs are recorded this is followed by a varint bitmask of the
+ * GPRs which changed since the previous record and, for each changed GPR in
+ * ascending order, a varint of its value XORed with its previous value.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libpdbg.h>
+
+#include "main.h"
+#include "optcmd.h"
+#include "parsers.h"
+#include "path.h"
+
+#define STEPTRACE_MAGIC		"PDBGSTEP"
+#define STEPTRACE_VERSION	1
+#define STEPTRACE_FLAG_GPRS	0x1
+
+struct steptrace {
+	FILE *file;
+	uint64_t nia;
+	uint64_t gprs[32];
+	uint64_t records;
+};
+
+static int put_varint(FILE *file, uint64_t value)
+{
+	do {
+		uint8_t byte = value & 0x7f;
+
+		value >>= 7;
+		if (value)
+			byte |= 0x80;
+
+		if (fputc(byte, file) == EOF)
+			return -1;
+	} while (value);
+
+	return 0;
+}
+
+static int steptrace_record(struct pdbg_target *thread, uint64_t nia,
+			    const uint64_t *gprs, void *priv)
+{
+	struct steptrace *trace = priv;
+	int64_t delta = nia - trace->nia;
+	uint32_t changed = 0;
+	int i;
+
+	if (put_varint(trace->file, ((uint64_t) delta << 1) ^ (delta >> 63)))
+		return -1;
+	trace->nia = nia;
+
+	if (gprs) {
+		for (i = 0; i < 32; i++)
+			if (!trace->records || gprs[i] != trace->gprs[i])
+				changed |= 1U << i;
+
+		if (put_varint(trace->file, changed))
+			return -1;
+
+		for (i = 0; i < 32; i++) {
+			if (!(changed & (1U << i)))
+				continue;
+
+			if (put_varint(trace->file, gprs[i] ^ trace->gprs[i]))
+				return -1;
+			trace->gprs[i] = gprs[i];
+		}
+	}
+
+	trace->records++;
+
+	return 0;
+}
+
+struct steptrace_flags {
+	bool gprs;
+};
+
+#define STEPTRACE_GPRS_FLAG ("--regs", gprs, parse_flag_noarg, false)
+
+static int steptrace(uint64_t steps, struct steptrace_flags flags)
+{
+	struct pdbg_target *target;
+	int count = 0;
+
+	for_each_path_target_class("thread", target) {
+		struct steptrace trace;
+		uint8_t header[2] = { STEPTRACE_VERSION, 0 };
+		char *filename;
+		int rc;
+
+		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		rc = asprintf(&filename, "steptrace-p%d-c%d-t%d.dump",
+			      pdbg_parent_index(target, "pib"),
+			      pdbg_parent_index(target, "core"),
+			      pdbg_target_index(target));
+		if (rc == -1)
+			continue;
+
+		memset(&trace, 0, sizeof(trace));
+		trace.file = fopen(filename, "w");
+		if (!trace.file) {
+			pdbg_log(PDBG_ERROR, "Unable to open %s\n", filename);
+			free(filename);
+			continue;
+		}
+
+		if (flags.gprs)
+			header[1] |= STEPTRACE_FLAG_GPRS;
+
+		fwrite(STEPTRACE_MAGIC, 1, strlen(STEPTRACE_MAGIC), trace.file);
+		fwrite(header, 1, sizeof(header), trace.file);
+
+		rc = ram_step_trace(target, steps, flags.gprs, steptrace_record, &trace);
+		if (fclose(trace.file))
+			rc = -1;
+
+		if (rc)
+			pdbg_log(PDBG_ERROR, "Failed to trace p%d:c%d:t%d\n",
+				 pdbg_parent_index(target, "pib"),
+				 pdbg_parent_index(target, "core"),
+				 pdbg_target_index(target));
+
+		printf("Wrote %" PRIu64 " steps to %s\n",
+		       trace.records ? trace.records - 1 : 0, filename);
+		free(filename);
+
+		if (!rc)
+			count++;
+	}
+
+	return count;
+}
+OPTCMD_DEFINE_CMD_WITH_FLAGS(steptrace, steptrace, (DATA), steptrace_flags,
+			     (STEPTRACE_GPRS_FLAG));
@@ -0,0 +1,121 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <poll.h>
+
+#include <libpdbg.h>
+
+#include "fake.dt.h"
+
+#define OPS_PER_TARGET	16
+
+static int submit_all(struct pdbg_async *queue, struct pdbg_async_op *ops,
+		      const char *classname, enum pdbg_async_type type)
+{
+	struct pdbg_target *target;
+	int i, n = 0;
+
+	pdbg_for_each_class_target(classname, target) {
+		if (pdbg_target_probe(target) != PDBG_TARGET_ENABLED)
+			continue;
+
+		for (i = 0; i < OPS_PER_TARGET; i++, n++) {
+			ops[n].type = type;
+			ops[n].target = target;
+			ops[n].addr = i;
+			ops[n].data = 0;
+			ops[n].rc = -1;
+			assert(!pdbg_async_submit(queue, &ops[n]));
+		}
+	}
+
+	return n;
+}
+
+int main(void)
+{
+	struct pdbg_async *queue;
+	struct pdbg_async_op *ops, *op;
+	struct pdbg_target *target;
+	struct pollfd pfd;
+	int count = 0, n, i;
+
+	pdbg_targets_init(&_binary_fake_dtb_o_start);
+
+	pdbg_for_each_class_target("pib", target)
+		count++;
+	pdbg_for_each_class_target("fsi", target)
+		count++;
+
+	ops = calloc(count * OPS_PER_TARGET, sizeof(*ops));
+	assert(ops);
+
+	queue = pdbg_async_create();
+	assert(queue);
+
+	/* Nothing to reap before anything is submitted */
+	assert(!pdbg_async_reap(queue, true));
+	assert(!pdbg_async_outstanding(queue));
+
+	n = submit_all(queue, ops, "pib", PDBG_ASYNC_PIB_READ);
+	n += submit_all(queue, ops + n, "fsi", PDBG_ASYNC_FSI_READ);
+	assert(n == count * OPS_PER_TARGET);
+
+	/* Reap half by polling the completion fd and the rest by waiting */
+	pfd.fd = pdbg_async_fd(queue);
+	pfd.events = POLLIN;
+	for (i = 0; i < n / 2; i++) {
+		op = pdbg_async_reap(queue, false);
+		if (!op) {
+			assert(poll(&pfd, 1, -1) == 1);
+			op = pdbg_async_reap(queue, false);
+		}
+		assert(op);
+		assert(op->rc == 0);
+		assert(op->data == 0xdeadbeef || op->data == 0xfeed0cfa);
+		op->priv = op;
+	}
+
+	assert(pdbg_async_outstanding(queue) == n - n / 2);
+
+	while ((op = pdbg_async_reap(queue, true))) {
+		assert(op->rc == 0);
+		assert(!op->priv);
+		op->priv = op;
+		i++;
+	}
+
+	assert(i == n);
+	assert(!pdbg_async_outstanding(queue));
+	assert(poll(&pfd, 1, 0) == 0);
+
+	for (i = 0; i < n; i++)
+		assert(ops[i].priv == &ops[i]);
+
+	/* Destroying the queue waits for outstanding operations */
+	n = submit_all(queue, ops, "pib", PDBG_ASYNC_PIB_WRITE);
+	pdbg_async_destroy(queue);
+
+	for (i = 0; i < n; i++)
+		assert(ops[i].rc == 0);
+
+	free(ops);
+	return 0;
+}
@@ -234,6 +234,29 @@ static void test3(void)
 	}
 }
 
+static void test4(void)
+{
+	struct pdbg_target *root, *target;
+
+	pdbg_targets_init(&_binary_fake_dtb_o_start);
+
+	root = pdbg_target_root();
+	assert(root);
+
+	for_each_target(root, check_status, PDBG_TARGET_UNKNOWN);
+
+	pdbg_set_parallel_probe(true);
+	pdbg_target_probe_all(root);
+	for_each_target(root, check_status, PDBG_TARGET_ENABLED);
+
+	pdbg_for_each_class_target("fsi", target) {
+		pdbg_target_release(target);
+	}
+	pdbg_for_each_class_target("fsi", target) {
+		for_each_target(target, check_status, PDBG_TARGET_RELEASED);
+	}
+}
+
 int main(void)
 {
 	int test_id = TEST_ID;
@@ -244,6 +267,8 @@ int main(void)
 		test2();
 	} else if (test_id == 3) {
 		test3();
+	} else if (test_id == 4) {
+		test4();
 	} else {
 		printf("No test for TEST_ID=%d\n", test_id);
 		return 1;
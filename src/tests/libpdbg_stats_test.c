@@ -0,0 +1,165 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <libpdbg.h>
+
+#include "fake.dt.h"
+
+struct trace_thread {
+	struct pdbg_target *pib;
+	pid_t tid;
+};
+
+static void *trace_thread(void *arg)
+{
+	struct trace_thread *t = arg;
+	uint64_t value;
+
+	t->tid = syscall(SYS_gettid);
+	assert(!pib_read(t->pib, 0x4000, &value));
+	return NULL;
+}
+
+static uint64_t bucket_total(struct pdbg_stat *stat)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < PDBG_STAT_BUCKETS; i++)
+		total += stat->buckets[i];
+
+	return total;
+}
+
+int main(void)
+{
+	struct pdbg_stat stats[PDBG_STAT_OP_COUNT];
+	struct pdbg_target *pib, *target;
+	char trace_path[] = "/tmp/pdbg-trace-XXXXXX", trace[4096], tid[32];
+	struct trace_thread threads[2];
+	pthread_t thread;
+	char *event;
+	uint32_t count32;
+	uint64_t value;
+	int i, count;
+	size_t len;
+	FILE *file;
+
+	close(mkstemp(trace_path));
+	pdbg_targets_init(&_binary_fake_dtb_o_start);
+
+	pib = pdbg_target_from_path(NULL, "/fsi@0/pib@10000");
+	assert(pib);
+	assert(pdbg_target_probe(pib) == PDBG_TARGET_ENABLED);
+
+	/* Nothing is recorded until statistics are enabled */
+	assert(!pib_read(pib, 0x1000, &value));
+	assert(!pdbg_stats_next_target(NULL));
+	pdbg_stats_get(NULL, stats, false);
+	assert(!stats[PDBG_STAT_PIB_READ].count);
+
+	pdbg_stats_enable(true);
+	for (i = 0; i < 10; i++)
+		assert(!pib_read(pib, 0x1000, &value));
+	assert(!pib_write(pib, 0x1000, value));
+
+	assert(pdbg_stats_next_target(NULL) == pib);
+	assert(!pdbg_stats_next_target(pib));
+
+	pdbg_stats_get(pib, stats, false);
+	assert(stats[PDBG_STAT_PIB_READ].count == 10);
+	assert(!stats[PDBG_STAT_PIB_READ].errors);
+	assert(bucket_total(&stats[PDBG_STAT_PIB_READ]) == 10);
+	assert(stats[PDBG_STAT_PIB_READ].max_ns <= stats[PDBG_STAT_PIB_READ].total_ns);
+	assert(stats[PDBG_STAT_PIB_WRITE].count == 1);
+	assert(!stats[PDBG_STAT_FSI_READ].count);
+
+	/* Reading and resetting the totals clears every target */
+	pdbg_stats_get(NULL, stats, true);
+	assert(stats[PDBG_STAT_PIB_READ].count == 10);
+	pdbg_stats_get(pib, stats, false);
+	assert(!stats[PDBG_STAT_PIB_READ].count);
+	assert(!bucket_total(&stats[PDBG_STAT_PIB_READ]));
+
+	/* Accesses through a child are recorded against the PIB */
+	count = 0;
+	pdbg_for_each_target("core", pib, target) {
+		assert(pdbg_target_probe(target) == PDBG_TARGET_ENABLED);
+		assert(!pib_read(target, 0x0, &value));
+		count++;
+	}
+	assert(count);
+	assert(!pdbg_stats_next_target(pib));
+	pdbg_stats_get(pib, stats, false);
+	assert(stats[PDBG_STAT_PIB_READ].count == count);
+
+	assert(pdbg_stat_bucket_ns(0) == 0);
+	assert(pdbg_stat_bucket_ns(1) == 1);
+	assert(pdbg_stat_bucket_ns(11) == 1024);
+
+	/* Traced operations are written out as complete events */
+	pdbg_stats_enable(false);
+	pdbg_trace_enable(true);
+	assert(!pib_write(pib, 0x2000, value));
+	assert(!fsi_read(pib, 0xc09, &count32));
+
+	/* A thread started after another has exited reuses its buffer but
+	 * the events of both are kept */
+	for (i = 0; i < 2; i++) {
+		threads[i].pib = pib;
+		assert(!pthread_create(&thread, NULL, trace_thread, &threads[i]));
+		pthread_join(thread, NULL);
+	}
+	pdbg_trace_enable(false);
+	assert(!pib_read(pib, 0x3000, &value));
+
+	pdbg_stats_get(NULL, stats, false);
+	assert(!stats[PDBG_STAT_PIB_WRITE].count);
+
+	assert(!pdbg_trace_write(trace_path));
+	file = fopen(trace_path, "r");
+	assert(file);
+	len = fread(trace, 1, sizeof(trace) - 1, file);
+	trace[len] = 0;
+	fclose(file);
+	unlink(trace_path);
+
+	assert(!strncmp(trace, "{\"traceEvents\":[", 16));
+	assert(strstr(trace, "\"name\":\"pib_write\""));
+	assert(strstr(trace, "\"name\":\"fsi_read\""));
+	assert(strstr(trace, "\"target\":\"/fsi@0\""));
+	for (i = 0; i < 2; i++) {
+		snprintf(tid, sizeof(tid), "\"tid\":%d,", threads[i].tid);
+		assert(strstr(trace, tid));
+	}
+
+	/* Only the two threads' reads were traced */
+	count = 0;
+	for (event = trace; (event = strstr(event, "\"name\":\"pib_read\"")); event++)
+		count++;
+	assert(count == 2);
+
+	return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <libpdbg.h>
 
+#include "target.h"
 #include "fake.dt.h"
 
 static int count_target(struct pdbg_target *parent, const char *classname)
@@ -65,23 +66,42 @@ int main(void)
 	const char *name;
 	int count, i;
 
+#ifdef TEST_LAZY
+	pdbg_set_lazy_expand(true);
+#endif
 	pdbg_targets_init(&_binary_fake_dtb_o_start);
 
 	root = pdbg_target_root();
 	assert(root);
 
+	assert(pdbg_target_contains_class(root, "thread"));
+	assert(!pdbg_target_contains_class(root, "root"));
+
 	count = count_class_target("fsi");
 	assert(count == 1);
 
 	count = count_class_target("pib");
 	assert(count == 8);
 
+#ifdef TEST_LAZY
+	/* Walking the PIBs only creates the targets leading to them */
+	pdbg_for_each_class_target("pib", target)
+		assert(!target->expanded);
+	assert(root->expanded_classes & target_class_bit("pib"));
+	assert(!root->subtree_expanded);
+#endif
+
 	count = count_class_target("core");
 	assert(count == 32);
 
 	count = count_class_target("thread");
 	assert(count == 64);
 
+#ifdef TEST_LAZY
+	/* Threads are the leaves so everything has been created for them */
+	assert(root->subtree_expanded);
+#endif
+
 	pdbg_for_each_class_target("fsi", target) {
 		parent = pdbg_target_parent("fsi", target);
 		assert(parent == NULL);
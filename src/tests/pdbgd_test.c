@@ -0,0 +1,179 @@
+/* Copyright 2018 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <libpdbg.h>
+
+#include "path.h"
+#include "pdbgd.h"
+
+#include "fake.dt.h"
+
+static char socket_path[64];
+
+static void *daemon_run(void *arg)
+{
+	assert(!pdbgd_run(socket_path));
+	return NULL;
+}
+
+static int daemon_connect(void)
+{
+	struct sockaddr_un addr;
+	int fd, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	/* The daemon may not be listening yet */
+	for (i = 0; i < 1000; i++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		assert(fd >= 0);
+		if (!connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+			return fd;
+
+		close(fd);
+		usleep(1000);
+	}
+
+	assert(0);
+	return -1;
+}
+
+static void read_full(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, buf, len);
+		assert(n > 0);
+		buf = (char *) buf + n;
+		len -= n;
+	}
+}
+
+static char *request(int fd, uint32_t op, uint32_t target, uint64_t addr,
+		     struct pdbgd_response *resp)
+{
+	struct pdbgd_request req;
+	char *payload;
+
+	memset(&req, 0, sizeof(req));
+	req.op = op;
+	req.target = target;
+	req.addr = addr;
+	assert(write(fd, &req, sizeof(req)) == sizeof(req));
+
+	read_full(fd, resp, sizeof(*resp));
+	payload = malloc(resp->len + 1);
+	assert(payload);
+	read_full(fd, payload, resp->len);
+	payload[resp->len] = '\0';
+
+	return payload;
+}
+
+int main(void)
+{
+	struct pdbgd_response resp;
+	struct pdbg_target *target;
+	pthread_t tid;
+	sigset_t mask;
+	char *payload, *path;
+	uint32_t count = 0, i;
+	int fd;
+
+	/* Client threads create targets as they look for them */
+	pdbg_set_lazy_expand(true);
+	pdbg_targets_init(&_binary_fake_dtb_o_start);
+
+	pdbg_for_each_class_target("pib", target) {
+		assert(path_target_add(target));
+		count++;
+	}
+	assert(count);
+
+	/* Blocked before the daemon starts so that every thread leaves the
+	 * signal to its signalfd */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	snprintf(socket_path, sizeof(socket_path), "/tmp/pdbgd_test.%d", getpid());
+	assert(!pthread_create(&tid, NULL, daemon_run, NULL));
+	fd = daemon_connect();
+
+	/* Every selected target is listed in order */
+	payload = request(fd, PDBGD_OP_TARGETS, 0, 0, &resp);
+	assert(resp.rc == 0);
+	i = 0;
+	for (path = payload; path < payload + resp.len; path += strlen(path) + 1)
+		i++;
+	assert(i == count);
+	assert(!strncmp(payload, "/fsi@0/pib@", strlen("/fsi@0/pib@")));
+	free(payload);
+
+	for (i = 0; i < count; i++) {
+		payload = request(fd, PDBGD_OP_GETSCOM, i, 0xf000f, &resp);
+		assert(resp.rc == 0);
+		assert(resp.len == 0);
+		assert(resp.data == 0xdeadbeef);
+		free(payload);
+	}
+
+	/* Finding a thread below the PIB creates the cores and threads */
+	payload = request(fd, PDBGD_OP_THREADSTATUS, 0, 0, &resp);
+	assert(resp.rc == 0);
+	free(payload);
+
+	payload = request(fd, PDBGD_OP_GETSCOM, count, 0xf000f, &resp);
+	assert(resp.rc == -ENODEV);
+	assert(resp.len == 0);
+	free(payload);
+
+	payload = request(fd, PDBGD_OP_THREADSTATUS + 1, 0, 0, &resp);
+	assert(resp.rc == -EINVAL);
+	assert(resp.len == 0);
+	free(payload);
+
+	payload = request(fd, 0, 0, 0, &resp);
+	assert(resp.rc == -EINVAL);
+	free(payload);
+
+	/* The connection is still usable after the errors */
+	payload = request(fd, PDBGD_OP_GETSCOM, 0, 0xf000f, &resp);
+	assert(resp.rc == 0);
+	assert(resp.data == 0xdeadbeef);
+	free(payload);
+
+	close(fd);
+	kill(getpid(), SIGTERM);
+	pthread_join(tid, NULL);
+	assert(access(socket_path, F_OK));
+
+	return 0;
+}
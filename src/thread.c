@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libpdbg.h>
 
@@ -141,35 +142,116 @@ no_flip:
 	return 0;
 }
 
-static int thread_start(void)
+/*
+ * Returns a mask of the selected and enabled threads on a core indexed by
+ * thread index and adds the number of them to *count.
+ */
+static uint64_t core_selected_threads(struct pdbg_target *core, int *count)
 {
-	struct pdbg_target *target;
-	int count = 0;
+	struct pdbg_target *thread;
+	uint64_t mask = 0;
 
-	for_each_path_target_class("thread", target) {
-		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+	pdbg_for_each_target("thread", core, thread) {
+		if (!path_target_selected(thread))
 			continue;
 
-		ram_start_thread(target);
-		count++;
+		if (pdbg_target_status(thread) != PDBG_TARGET_ENABLED)
+			continue;
+
+		mask |= 1ULL << pdbg_target_index(thread);
+		(*count)++;
+	}
+
+	return mask;
+}
+
+/*
+ * Returns the cores with selected threads in the order they were selected.
+ * Only looking at selected threads avoids creating the cores and threads of
+ * every chip.
+ */
+static int selected_cores(struct pdbg_target ***cores)
+{
+	struct pdbg_target *thread, *core, **list = NULL;
+	int i, count = 0;
+
+	for_each_path_target_class("thread", thread) {
+		core = pdbg_target_parent("core", thread);
+		for (i = 0; i < count; i++)
+			if (list[i] == core)
+				break;
+
+		if (i < count)
+			continue;
+
+		list = realloc(list, (count + 1) * sizeof(*list));
+		assert(list);
+		list[count++] = core;
 	}
 
+	*cores = list;
+	return count;
+}
+
+/*
+ * Cores are only woken up when first used. Wake up all the cores with
+ * selected threads together instead of one at a time.
+ */
+static void wakeup_selected_cores(void)
+{
+	struct pdbg_target **cores;
+	int i, count, ncores, nwakeup = 0;
+
+	ncores = selected_cores(&cores);
+	for (i = 0; i < ncores; i++) {
+		count = 0;
+		if (core_selected_threads(cores[i], &count))
+			cores[nwakeup++] = cores[i];
+	}
+
+	core_special_wakeup(cores, nwakeup);
+	free(cores);
+}
+
+static int thread_start(void)
+{
+	struct pdbg_target **cores;
+	uint64_t mask;
+	int i, ncores, count = 0;
+
+	wakeup_selected_cores();
+
+	ncores = selected_cores(&cores);
+	for (i = 0; i < ncores; i++) {
+		mask = core_selected_threads(cores[i], &count);
+		if (mask)
+			ram_start_core(cores[i], mask);
+	}
+	free(cores);
+
 	return count;
 }
 OPTCMD_DEFINE_CMD(start, thread_start);
 
 static int thread_step(uint64_t steps)
 {
-	struct pdbg_target *target;
-	int count = 0;
+	struct pdbg_target **cores;
+	uint64_t mask;
+	int i, ncores, selected = 0, count = 0;
 
-	for_each_path_target_class("thread", target) {
-		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+	wakeup_selected_cores();
+
+	ncores = selected_cores(&cores);
+	for (i = 0; i < ncores; i++) {
+		mask = core_selected_threads(cores[i], &selected);
+		if (!mask)
 			continue;
 
-		ram_step_thread(target, (int)steps);
-		count++;
+		/* Only count the threads which were actually stepped */
+		ram_step_core(cores[i], &mask, (int)steps);
+		count += __builtin_popcountll(mask);
 	}
+	free(cores);
 
 	return count;
 }
@@ -177,17 +259,34 @@ OPTCMD_DEFINE_CMD_WITH_ARGS(step, thread_step, (DATA));
 
 static int thread_stop(void)
 {
-	struct pdbg_target *target;
-	int count = 0;
-
-	for_each_path_target_class("thread", target) {
-		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
+	struct pdbg_target **cores;
+	uint64_t mask, *masks, skew;
+	int i, count = 0, ncores = 0, nselected;
+
+	/* Work out which threads to stop on every core first so that all
+	 * of them can be stopped together */
+	nselected = selected_cores(&cores);
+	masks = calloc(nselected, sizeof(*masks));
+	assert(masks || !nselected);
+	for (i = 0; i < nselected; i++) {
+		mask = core_selected_threads(cores[i], &count);
+		if (!mask)
 			continue;
 
-		ram_stop_thread(target);
-		count++;
+		cores[ncores] = cores[i];
+		masks[ncores] = mask;
+		ncores++;
 	}
 
+	if (ncores) {
+		ram_stop_cores(cores, masks, ncores, &skew);
+		printf("Stopped %d threads on %d cores, skew %" PRIu64 ".%03" PRIu64 " us\n",
+		       count, ncores, skew / 1000, skew % 1000);
+	}
+
+	free(cores);
+	free(masks);
+
 	return count;
 }
 OPTCMD_DEFINE_CMD(stop, thread_stop);
@@ -249,6 +348,8 @@ static int thread_status_print(void)
 		assert(path_target_add(pib));
 	}
 
+	wakeup_selected_cores();
+
 	pib = __pdbg_next_target("pib", pdbg_target_root(), NULL);
 	assert(pib);
 
@@ -275,6 +376,10 @@ static int thread_status_print(void)
 			if (pdbg_target_status(core) != PDBG_TARGET_ENABLED)
 				continue;
 
+			/* The threads may have changed state since the
+			 * status was last read */
+			thread_status_refresh(core);
+
 			printf("c%02d:  ", pdbg_target_index(core));
 
 			pdbg_for_each_target("thread", core, thread)
@@ -292,6 +397,8 @@ static int thread_sreset(void)
 	struct pdbg_target *target;
 	int count = 0;
 
+	wakeup_selected_cores();
+
 	for_each_path_target_class("thread", target) {
 		if (pdbg_target_status(target) != PDBG_TARGET_ENABLED)
 			continue;
@@ -311,30 +418,112 @@ struct reg_flags {
 
 #define REG_BACKTRACE_FLAG ("--backtrace", do_backtrace, parse_flag_noarg, false)
 
+struct regs_capture {
+	struct pdbg_target *thread;
+	struct pdbg_target *pib;
+	struct thread_regs regs;
+	int rc;
+};
+
+struct regs_worker {
+	pthread_t tid;
+	bool started;
+	struct pdbg_target *pib;
+	struct regs_capture *captures;
+	int count;
+};
+
+/*
+ * Capture the registers of all threads on one chip. Threads are captured one
+ * at a time as threads on the same core share the RAM registers.
+ */
+static void *regs_worker(void *arg)
+{
+	struct regs_worker *worker = arg;
+	int i;
+
+	for (i = 0; i < worker->count; i++) {
+		struct regs_capture *capture = &worker->captures[i];
+
+		if (capture->pib != worker->pib)
+			continue;
+
+		capture->rc = ram_getregs(capture->thread, &capture->regs);
+	}
+
+	return NULL;
+}
+
 static int thread_regs_print(struct reg_flags flags)
 {
 	struct pdbg_target *pib, *core, *thread;
-	struct thread_regs regs;
-	int count = 0;
+	struct regs_capture *captures = NULL;
+	struct regs_worker *workers = NULL;
+	int i, j, nthreads = 0, nworkers = 0, count = 0;
+
+	wakeup_selected_cores();
 
 	for_each_path_target_class("thread", thread) {
+		captures = realloc(captures, (nthreads + 1) * sizeof(*captures));
+		assert(captures);
+		captures[nthreads].thread = thread;
+		captures[nthreads].pib = pdbg_target_parent("pib", thread);
+		captures[nthreads].rc = -1;
+		nthreads++;
+	}
+
+	/* One worker per chip */
+	for (i = 0; i < nthreads; i++) {
+		for (j = 0; j < nworkers; j++)
+			if (workers[j].pib == captures[i].pib)
+				break;
+
+		if (j < nworkers)
+			continue;
+
+		workers = realloc(workers, (nworkers + 1) * sizeof(*workers));
+		assert(workers);
+		workers[nworkers].pib = captures[i].pib;
+		workers[nworkers].captures = captures;
+		workers[nworkers].count = nthreads;
+		nworkers++;
+	}
+
+	/* Capture all chips concurrently, falling back to capturing in this
+	 * thread if a worker can't be started */
+	for (i = 0; i < nworkers; i++) {
+		workers[i].started = nworkers > 1 &&
+			!pthread_create(&workers[i].tid, NULL, regs_worker, &workers[i]);
+		if (!workers[i].started)
+			regs_worker(&workers[i]);
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		if (workers[i].started)
+			pthread_join(workers[i].tid, NULL);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		thread = captures[i].thread;
 		core = pdbg_target_parent("core", thread);
-		pib = pdbg_target_parent("pib", core);
+		pib = captures[i].pib;
 
 		printf("p%d c%d t%d\n",
 		       pdbg_target_index(pib),
 		       pdbg_target_index(core),
 		       pdbg_target_index(thread));
 
-		if (ram_state_thread(thread, &regs))
+		if (captures[i].rc)
 			continue;
 
+		ram_print_regs(&captures[i].regs);
+
 		if (flags.do_backtrace) {
 			struct pdbg_target *adu;
 
 			pdbg_for_each_class_target("adu", adu) {
 				if (pdbg_target_probe(adu) == PDBG_TARGET_ENABLED) {
-					dump_stack(&regs, adu);
+					dump_stack(&captures[i].regs, adu);
 					break;
 				}
 			}
@@ -343,6 +532,9 @@ static int thread_regs_print(struct reg_flags flags)
 		count++;
 	}
 
+	free(workers);
+	free(captures);
+
 	return count;
 }
 OPTCMD_DEFINE_CMD_ONLY_FLAGS(regs, thread_regs_print, reg_flags, (REG_BACKTRACE_FLAG));
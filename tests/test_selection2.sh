@@ -557,3 +557,417 @@ EOF
 
 do_skip
 test_run pdbg -b fake -P "fsi0/pib%d" probe
+
+test_result 0 <<EOF
+fsi0: Fake FSI (*)
+    pib0: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib1: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib2: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib3: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib4: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib5: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib6: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib7: Fake PIB (*)
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "*" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib1: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib2: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib3: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib4: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib5: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib6: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+    pib7: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib/*" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib1: Fake PIB
+        core0: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core1: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core2: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+        core3: Fake Core (*)
+            thread0: Fake Thread (*)
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib1/*" probe
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib1: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib2: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib3: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib4: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib5: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib6: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib7: Fake PIB
+        core0: Fake Core
+            thread1: Fake Thread (*)
+        core1: Fake Core
+            thread1: Fake Thread (*)
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "th*d1" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib2: Fake PIB (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "p?b2" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core1: Fake Core (*)
+        core2: Fake Core (*)
+        core3: Fake Core (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib0/core[!0]" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core0: Fake Core (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib[^1-7]/core0" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core0: Fake Core (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "core@10010" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib1: Fake PIB
+        core1: Fake Core
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib@11000/core@11020/thread1" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib0: Fake PIB
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib1: Fake PIB
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib6: Fake PIB
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+    pib7: Fake PIB
+        core2: Fake Core
+            thread1: Fake Thread (*)
+        core3: Fake Core
+            thread1: Fake Thread (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib[0-1,6-7]/core[2-3]/thread1" probe
+
+
+test_result 0 <<EOF
+fsi0: Fake FSI
+    pib7: Fake PIB
+        core0: Fake Core (*)
+        core3: Fake Core (*)
+EOF
+
+do_skip
+test_run pdbg -b fake -P "pib[!0-6]/core[0,3]" probe